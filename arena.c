@@ -0,0 +1,122 @@
+/* arena.c - per-cycle bump allocator for transient update data
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "defines.h"
+#include "arena.h"
+#include "malloc.h"
+
+/*
+ * Requests, their parser state and the addresses fetched while looking for
+ * changes live only until the end of the update cycle.  They are carved
+ * from a list of chunks that arena_reset() rewinds when the cycle ends, so
+ * nothing is freed piecemeal and, once the chunks have grown to cover a
+ * busy cycle, a cycle makes no heap allocations of its own.  Chunks are
+ * never returned to the heap.
+ */
+
+typedef struct chunk {
+    struct chunk *next;
+    size_t size, used;
+    /* data follows, aligned as arena_align */
+} chunk_t;
+
+typedef union {
+    long double d;
+    void *p;
+    long long l;
+} arena_align;
+
+#define CHUNK_HDR ((sizeof (chunk_t) + sizeof (arena_align) - 1) & \
+                   ~(sizeof (arena_align) - 1))
+
+static chunk_t *chunks, *cur;
+arena_stats_t arena_stats;
+
+static chunk_t *chunk_new(size_t size)
+{
+    chunk_t *c;
+
+    if (size < ARENA_CHUNK)
+        size = ARENA_CHUNK;
+    c = xmalloc(CHUNK_HDR + size);
+    c->next = NULL;
+    c->size = size;
+    c->used = 0;
+    ++arena_stats.chunks;
+    arena_stats.size += size;
+    return c;
+}
+
+void *arena_alloc(size_t size)
+{
+    size_t align = sizeof (arena_align);
+    void *ret;
+
+    size = (size + align - 1) & ~(align - 1);
+    if (!cur)
+        cur = chunks = chunk_new(size);
+    /* Move on to the next chunk that fits, putting a new one ahead if
+     * the next is missing or too small; chunks ahead of cur are unused. */
+    while (cur->size - cur->used < size) {
+        if (!cur->next || cur->next->size < size) {
+            chunk_t *c = chunk_new(size);
+            c->next = cur->next;
+            cur->next = c;
+        }
+        cur = cur->next;
+    }
+    ret = (char *)cur + CHUNK_HDR + cur->used;
+    cur->used += size;
+    arena_stats.used += size;
+    if (arena_stats.used > arena_stats.peak)
+        arena_stats.peak = arena_stats.used;
+    return ret;
+}
+
+char *arena_strdup(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *ret = arena_alloc(len);
+
+    memcpy(ret, s, len);
+    return ret;
+}
+
+/* Releases everything allocated since the last reset. */
+void arena_reset(void)
+{
+    chunk_t *c;
+
+    for (c = chunks; c; c = c->next)
+        c->used = 0;
+    cur = chunks;
+    arena_stats.used = 0;
+}
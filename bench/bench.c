@@ -0,0 +1,407 @@
+/* bench.c - update cycle benchmark against a local mock provider
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Runs complete update cycles for N generated hosts per provider against
+ * mockprov.py, alternating between two addresses so that every host is
+ * updated on every cycle, and reports per-cycle wall time, transfers,
+ * new connections (each with a TLS handshake when https is used) and heap
+ * allocations made by ndyndns and libcurl, the latter also counted apart.
+ * Once its arena has grown, a cycle of ndyndns itself allocates nothing
+ * from the heap.  run.sh adds syscall counts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <curl/curl.h>
+
+#include "defines.h"
+#include "log.h"
+#include "chroot.h"
+#include "malloc.h"
+#include "hostlist.h"
+#include "source.h"
+#include "transport.h"
+#include "state.h"
+#include "arena.h"
+#include "util.h"
+#include "dns_dyn.h"
+#include "dns_nc.h"
+#include "dns_he.h"
+#include "stun.h"
+
+int use_ssl = 0;
+
+/* Linked with --wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=strdup. */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static unsigned long nallocs, ncurl;
+
+void *__wrap_malloc(size_t size)
+{
+    ++nallocs;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    ++nallocs;
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    ++nallocs;
+    return __real_realloc(ptr, size);
+}
+
+/* strdup() allocates inside libc, past the malloc wrapper. */
+char *__wrap_strdup(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *r = __wrap_malloc(len);
+
+    if (r)
+        memcpy(r, s, len);
+    return r;
+}
+
+/* libcurl is a shared library, so its allocations are routed through
+ * the wrapped functions above. */
+static void *bench_malloc(size_t size) { ++ncurl; return malloc(size); }
+static void bench_free(void *ptr) { free(ptr); }
+static void *bench_realloc(void *ptr, size_t size)
+{
+    ++ncurl;
+    return realloc(ptr, size);
+}
+static void *bench_calloc(size_t nmemb, size_t size)
+{
+    ++ncurl;
+    return calloc(nmemb, size);
+}
+static char *bench_strdup(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *r;
+
+    ++ncurl;
+    r = malloc(len);
+
+    if (r)
+        memcpy(r, s, len);
+    return r;
+}
+
+/* Adds hosts named <prefix><i><suffix> for i below n. */
+static void add_hosts(hostlist_t *l, char *prefix, char *suffix, int n,
+                      char *password)
+{
+    char name[MAX_BUF];
+    hostdata_t *hd;
+    int i;
+
+    for (i = 0; i < n; ++i) {
+        snprintf(name, sizeof name, "%s%d%s", prefix, i, suffix);
+        hd = xmalloc(sizeof (hostdata_t));
+        memset(hd, 0, sizeof *hd);
+        hd->host = strdup(name);
+        hd->password = password ? strdup(password) : NULL;
+        hd->ip = addr_dup("0.0.0.0");
+        hostlist_append(l, hd);
+    }
+}
+
+/* Returns nonzero if name is one of the comma-separated entries in list. */
+static int has_provider(char *list, char *name)
+{
+    size_t len = strlen(name);
+    char *p = list;
+
+    while (p && *p) {
+        if (!strncmp(p, name, len) && (p[len] == ',' || p[len] == '\0'))
+            return 1;
+        p = strchr(p, ',');
+        if (p)
+            ++p;
+    }
+    return 0;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* Asks the STUN server added with -s for the address rounds times.  Any
+ * answer must be the address that mockprov.py reports by default; with
+ * BENCH_ERRORS some queries may go unanswered.  Returns nonzero if an
+ * answer is wrong. */
+static int bench_stun(int rounds)
+{
+    double t0, t, tot = 0;
+    char *ip;
+    int i, lost = 0, bad = 0;
+
+    for (i = 0; i < rounds; ++i) {
+        t0 = now_ms();
+        ip = stun_query(AF_INET, NULL);
+        t = now_ms() - t0;
+        printf("stun query %d: %.3f ms, %s\n", i, t, ip ? ip : "no answer");
+        lost += !ip;
+        bad |= ip && strcmp(ip, "192.0.2.1");
+        tot += t;
+        arena_reset();
+    }
+    printf("stun mean: %.3f ms per query, %d unanswered\n", tot / rounds,
+           lost);
+    return bad;
+}
+
+/* Times the dyndns2 reply parser on a reply for n hosts, fed in chunks of
+ * random size, and checks every status against the one written.  Tokens
+ * that merely contain a keyword are mixed in and must be ignored. */
+static int bench_parse(int n, int rounds)
+{
+    static const char * const lines[] = {
+        "good 192.0.2.1", "nochg 192.0.2.1", "badauth", "!yours",
+        "dnserr", "911", "numhost"
+    };
+    static const return_codes codes[] = {
+        RET_GOOD, RET_NOCHG, RET_BADAUTH, RET_NOTYOURS,
+        RET_DNSERR, RET_911, RET_NUMHOST
+    };
+    static const char * const junk[] = {
+        "goodbye", "nochg!", "x911", "<br>", "badauthbadauthbadauthbadauth"
+    };
+    const int reps = 1000;
+    return_codes *want, *got;
+    size_t len = 0, chunk, got_n = 0;
+    char *buf;
+    double t0, t;
+    int i, k, bad = 0;
+
+    buf = xmalloc((size_t)n * 64);
+    want = xmalloc(n * sizeof *want);
+    got = xmalloc(n * sizeof *got);
+    srand(1);
+    for (i = 0; i < n; ++i) {
+        k = rand() % (int)(sizeof lines / sizeof lines[0]);
+        if (rand() % 4 == 0)
+            len += sprintf(buf + len, "%s ",
+                           junk[rand() % (int)(sizeof junk / sizeof junk[0])]);
+        len += sprintf(buf + len, "%s\n", lines[k]);
+        want[i] = codes[k];
+    }
+
+    printf("dyndns2 reply for %d hosts, %lu bytes\n", n, (unsigned long)len);
+    for (i = 0; i < rounds; ++i) {
+        chunk = i ? 1 + rand() % 4096 : 1;
+        t0 = now_ms();
+        for (k = 0; k < reps; ++k)
+            got_n = dyndns_parse_reply(buf, len, chunk, got, n);
+        t = (now_ms() - t0) / reps;
+        k = got_n == (size_t)n && !memcmp(got, want, n * sizeof *got);
+        printf("round %d: %.3f ms, %.1f ns per host, %lu byte chunks, %s\n",
+               i, t, t * 1e6 / n, (unsigned long)chunk, k ? "ok" : "WRONG");
+        bad |= !k;
+    }
+    free(buf);
+    free(want);
+    free(got);
+    return bad;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+"Usage: ndyndns-bench -u URL [OPTIONS]\n"
+"       ndyndns-bench -k [-n N] [-c N]\n"
+"  -u, --url URL        base URL of the mock provider\n"
+"  -n, --hosts N        hosts per provider (default: 100)\n"
+"  -c, --cycles N       update cycles to run (default: 5)\n"
+"  -p, --providers LIST dyndns,namecheap,he,tunnel (default: all)\n"
+"  -d, --dir DIR        empty directory for state (default: new in /tmp)\n"
+"  -6, --ipv6           publish an IPv6 address as well\n"
+"  -s, --stun SERVER    then time STUN queries to SERVER (host:port)\n"
+"  -v, --verbose        keep ndyndns log output\n"
+"  -k, --parse          time the dyndns2 reply parser alone instead\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    char *url = NULL, *stun = NULL, *which = "dyndns,namecheap,he,tunnel";
+    char tmpdir[] = "/tmp/ndyndns-bench.XXXXXX", *dir = NULL;
+    char var[MAX_PATH_LENGTH];
+    int nhosts = 100, cycles = 5, ipv6 = 0, parse = 0, c, i;
+    unsigned long tot_req = 0, tot_conn = 0, tot_alloc = 0, tot_own = 0;
+    double t0, t, tot_ms = 0;
+    source_t *src;
+
+    static struct option long_options[] = {
+        {"url", 1, 0, 'u'},
+        {"hosts", 1, 0, 'n'},
+        {"cycles", 1, 0, 'c'},
+        {"providers", 1, 0, 'p'},
+        {"dir", 1, 0, 'd'},
+        {"ipv6", 0, 0, '6'},
+        {"stun", 1, 0, 's'},
+        {"verbose", 0, 0, 'v'},
+        {"parse", 0, 0, 'k'},
+        {0, 0, 0, 0}
+    };
+
+    gflags_quiet = 1;
+    while ((c = getopt_long(argc, argv, "u:n:c:p:d:6s:vk", long_options,
+                            NULL)) != -1) {
+        switch (c) {
+            case 'u': url = optarg; break;
+            case 'n': nhosts = atoi(optarg); break;
+            case 'c': cycles = atoi(optarg); break;
+            case 'p': which = optarg; break;
+            case 'd': dir = optarg; break;
+            case '6': ipv6 = 1; break;
+            case 's': stun = optarg; break;
+            case 'v': gflags_quiet = 0; break;
+            case 'k': parse = 1; break;
+            default: usage();
+        }
+    }
+    if (nhosts < 1 || cycles < 1)
+        usage();
+    if (parse)
+        return bench_parse(nhosts, cycles);
+    if (!url)
+        usage();
+
+    if (!dir) {
+        dir = mkdtemp(tmpdir);
+        if (!dir)
+            suicide("mkdtemp failed: %s", strerror(errno));
+    }
+    snprintf(var, sizeof var, "%s/var", dir);
+    if (mkdir(var, 0700))
+        suicide("mkdir %s failed: %s", var, strerror(errno));
+    /* Stand in for the chroot, where state files are written relative
+     * to the working directory. */
+    if (chdir(dir))
+        suicide("chdir %s failed: %s", dir, strerror(errno));
+    update_chroot(dir);
+
+    curl_global_init_mem(CURL_GLOBAL_ALL, bench_malloc, bench_free,
+                         bench_realloc, bench_strdup, bench_calloc);
+
+    providers_init();
+    if (has_provider(which, "dyndns")) {
+        dyndns_conf.username = "bench";
+        dyndns_conf.password = "bench";
+        dyndns_conf.server = url;
+        add_hosts(&dyndns_conf.hostlist, "dd", ".bench.invalid", nhosts,
+                  NULL);
+    }
+    if (has_provider(which, "namecheap")) {
+        namecheap_conf.password = "bench";
+        namecheap_conf.server = url;
+        add_hosts(&namecheap_conf.hostlist, "nc", ".bench.invalid", nhosts,
+                  NULL);
+    }
+    if (has_provider(which, "he")) {
+        he_conf.server = url;
+        add_hosts(&he_conf.hostpairs, "he", ".bench.invalid", nhosts,
+                  "bench");
+    }
+    if (has_provider(which, "tunnel")) {
+        he_conf.userid = "bench";
+        he_conf.passhash = "bench";
+        he_conf.tunserver = url;
+        add_hosts(&he_conf.tunlist, "", "", nhosts, NULL);
+    }
+
+    /* Every host reads the default source, which holds the addresses that
+     * each cycle publishes. */
+    src = source_default();
+    src->kind = SRC_STATIC;
+    src->used = 1;
+    for (i = 0; i < PROV_MAX; ++i)
+        hostlist_bind_default(providers[i]->list, src);
+    providers_compile();
+
+    printf("%d hosts per provider (%s), %d cycles against %s\n",
+           nhosts, which, cycles, url);
+    for (i = 0; i < cycles; ++i) {
+        free(src->addr4);
+        free(src->addr6);
+        src->addr4 = strdup(i & 1 ? "192.0.2.2" : "192.0.2.1");
+        src->addr6 = !ipv6 ? NULL :
+            strdup(i & 1 ? "2001:db8::2" : "2001:db8::1");
+        source_refresh();
+
+        memset(&transport_stats, 0, sizeof transport_stats);
+        nallocs = ncurl = 0;
+        t0 = now_ms();
+        providers_work();
+        transport_run();
+        state_commit();
+        arena_reset();
+        t = now_ms() - t0;
+
+        printf("cycle %d: %.3f ms, %lu requests (%lu over HTTP/2), "
+               "%lu handshakes, %lu allocations (%lu by libcurl), "
+               "%lu KB arena\n", i, t, transport_stats.requests,
+               transport_stats.streams, transport_stats.connects, nallocs,
+               ncurl, (unsigned long)arena_stats.peak / 1024);
+        tot_ms += t;
+        tot_req += transport_stats.requests;
+        tot_conn += transport_stats.connects;
+        tot_alloc += nallocs;
+        tot_own += nallocs - ncurl;
+    }
+    printf("mean: %.3f ms, %.1f requests, %.1f handshakes, "
+           "%.1f allocations (%.1f outside libcurl) per cycle\n",
+           tot_ms / cycles, (double)tot_req / cycles,
+           (double)tot_conn / cycles, (double)tot_alloc / cycles,
+           (double)tot_own / cycles);
+    if (stun) {
+        stun_add_server(stun);
+        return bench_stun(cycles);
+    }
+    return 0;
+}
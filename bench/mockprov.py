@@ -0,0 +1,201 @@
+#!/usr/bin/env python3
+# mockprov.py - local stand-in for the update providers used by the benchmark
+#
+# Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+# All rights reserved.  Licensed under the same terms as ndyndns.
+
+"""Answers the update requests that ndyndns sends, over http or https.
+
+  /nic/update     dyndns2 and dyn.dns.he.net: one 'good' or 'nochg' per host
+  /update         Namecheap: <ErrCount>0 or 1
+  /ipv4_end.php   HE tunnelbroker: '+OK' or '-ERROR'
+  /               checkip: 'Current IP Address: ...'
+  /_stats         request and connection counts as JSON (not counted)
+
+With --stun-port it also answers STUN Binding requests over UDP, on the
+loopback address of the same family as --checkip, mapping every client to
+the --checkip address.
+
+--latency and --jitter delay every response.  --error-rate answers that
+fraction of requests with HTTP 500, and --fail-rate answers that fraction
+with the provider's own failure response.
+"""
+
+import argparse
+import json
+import random
+import socket
+import ssl
+import struct
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import urlsplit, parse_qs
+
+lock = threading.Lock()
+stats = {"requests": 0, "connections": 0, "stun": 0}
+published = {}
+opts = None
+
+
+def count(key):
+    with lock:
+        stats[key] += 1
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    disable_nagle_algorithm = True
+
+    def setup(self):
+        count("connections")
+        super().setup()
+
+    def log_message(self, fmt, *args):
+        pass
+
+    def reply(self, code, body, ctype="text/plain"):
+        body = body.encode()
+        self.send_response(code)
+        self.send_header("Content-Type", ctype)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_GET(self):
+        url = urlsplit(self.path)
+        q = parse_qs(url.query)
+
+        if url.path == "/_stats":
+            with lock:
+                body = json.dumps(stats)
+            self.reply(200, body + "\n", "application/json")
+            return
+
+        count("requests")
+        delay = opts.latency + random.uniform(0, opts.jitter)
+        if delay > 0:
+            time.sleep(delay / 1000.0)
+        if random.random() < opts.error_rate:
+            self.reply(500, "internal error\n")
+            return
+        fail = random.random() < opts.fail_rate
+
+        if url.path == "/nic/update":
+            ip = q.get("myip", ["0.0.0.0"])[0]
+            hosts = ",".join(q.get("hostname", [])).split(",")
+            lines = []
+            for h in hosts:
+                if fail:
+                    lines.append("dnserr")
+                    continue
+                with lock:
+                    old = published.get(h)
+                    published[h] = ip
+                lines.append(("nochg " if old == ip else "good ") + ip)
+            self.reply(200, "\n".join(lines) + "\n")
+        elif url.path == "/update":
+            errs = 1 if fail else 0
+            self.reply(200, "<?xml version=\"1.0\"?>\r\n<interface-response>"
+                       "<Command>SETDNSHOST</Command><Language>eng</Language>"
+                       "<IP>%s</IP><ErrCount>%d</ErrCount><Done>true</Done>"
+                       "</interface-response>\r\n"
+                       % (q.get("ip", [""])[0], errs), "text/html")
+        elif url.path == "/ipv4_end.php":
+            ip = q.get("ip", [""])[0]
+            if fail:
+                self.reply(200, "-ERROR: Invalid API key or password\n")
+            else:
+                self.reply(200, "+OK: Tunnel endpoint updated to: %s\n" % ip)
+        elif url.path == "/":
+            self.reply(200, "<html><head><title>Current IP Check</title>"
+                       "</head><body>Current IP Address: %s</body></html>\r\n"
+                       % opts.checkip, "text/html")
+        else:
+            self.reply(404, "not found\n")
+
+
+STUN_MAGIC = 0x2112A442
+
+
+def stun_reply(req, ip):
+    """Builds the Binding success response to req, or returns None."""
+    if len(req) < 20:
+        return None
+    kind, _, magic = struct.unpack("!HHI", req[:8])
+    if kind != 0x0001 or magic != STUN_MAGIC:
+        return None
+    txid = req[8:20]
+    if ":" in ip:
+        key = struct.pack("!I", STUN_MAGIC) + txid
+        raw = socket.inet_pton(socket.AF_INET6, ip)
+        value = struct.pack("!BBH", 0, 2, 3478 ^ (STUN_MAGIC >> 16))
+    else:
+        key = struct.pack("!I", STUN_MAGIC)
+        raw = socket.inet_pton(socket.AF_INET, ip)
+        value = struct.pack("!BBH", 0, 1, 3478 ^ (STUN_MAGIC >> 16))
+    value += bytes(a ^ b for a, b in zip(raw, key))
+    attr = struct.pack("!HH", 0x0020, len(value)) + value
+    return struct.pack("!HHI", 0x0101, len(attr), STUN_MAGIC) + txid + attr
+
+
+def serve_stun(port):
+    # Clients must ask over the family of the address that they are told.
+    if ":" in opts.checkip:
+        sock = socket.socket(socket.AF_INET6, socket.SOCK_DGRAM)
+        sock.bind(("::1", port))
+    else:
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        sock.bind(("127.0.0.1", port))
+    while True:
+        req, addr = sock.recvfrom(2048)
+        count("stun")
+        if random.random() < opts.error_rate:
+            continue
+        delay = opts.latency + random.uniform(0, opts.jitter)
+        if delay > 0:
+            time.sleep(delay / 1000.0)
+        rep = stun_reply(req, opts.checkip)
+        if rep:
+            sock.sendto(rep, addr)
+
+
+class Server(ThreadingHTTPServer):
+    daemon_threads = True
+    ctx = None
+
+    def get_request(self):
+        sock, addr = self.socket.accept()
+        if self.ctx:
+            # The handshake runs on the handler thread.
+            sock = self.ctx.wrap_socket(sock, server_side=True,
+                                        do_handshake_on_connect=False)
+        return sock, addr
+
+
+def main():
+    global opts
+    p = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    p.add_argument("--port", type=int, default=8053)
+    p.add_argument("--cert", help="serve https with this certificate")
+    p.add_argument("--key", help="private key for --cert")
+    p.add_argument("--latency", type=float, default=0, help="ms per reply")
+    p.add_argument("--jitter", type=float, default=0, help="extra random ms")
+    p.add_argument("--error-rate", type=float, default=0)
+    p.add_argument("--fail-rate", type=float, default=0)
+    p.add_argument("--checkip", default="192.0.2.1")
+    p.add_argument("--stun-port", type=int, help="also answer STUN on UDP")
+    opts = p.parse_args()
+
+    if opts.stun_port:
+        threading.Thread(target=serve_stun, args=(opts.stun_port,),
+                         daemon=True).start()
+    srv = Server(("127.0.0.1", opts.port), Handler)
+    if opts.cert:
+        srv.ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        srv.ctx.load_cert_chain(opts.cert, opts.key)
+    srv.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,59 @@
+#!/bin/sh
+# run.sh - starts mockprov.py and runs ndyndns-bench against it
+#
+# Usage: run.sh [path/to/ndyndns-bench]
+#
+# Tunables (environment):
+#   BENCH_HOSTS      hosts per provider (100)
+#   BENCH_CYCLES     update cycles (5)
+#   BENCH_PROVIDERS  dyndns,namecheap,he,tunnel
+#   BENCH_TLS        1 to serve https with a throwaway certificate (0)
+#   BENCH_IPV6       1 to publish an IPv6 address as well (0)
+#   BENCH_LATENCY    ms added to every reply (0)
+#   BENCH_JITTER     extra random ms per reply (0)
+#   BENCH_ERRORS     fraction of replies that are HTTP 500 (0)
+#   BENCH_FAILURES   fraction of replies that are provider failures (0)
+#   BENCH_PORT       port for the mock server (8053)
+#   BENCH_STUN_PORT  UDP port for its STUN responder (BENCH_PORT + 1)
+
+BIN=${1:-./bench/ndyndns-bench}
+DIR=$(cd "$(dirname "$0")" && pwd)
+PORT=${BENCH_PORT:-8053}
+STUN_PORT=${BENCH_STUN_PORT:-$((PORT + 1))}
+TMP=$(mktemp -d /tmp/ndyndns-mock.XXXXXX) || exit 1
+trap 'kill $MOCK 2>/dev/null; rm -rf "$TMP"' EXIT INT TERM
+
+SCHEME=http
+MOCKARGS="--port $PORT --stun-port $STUN_PORT"
+MOCKARGS="$MOCKARGS --latency ${BENCH_LATENCY:-0} --jitter ${BENCH_JITTER:-0}"
+MOCKARGS="$MOCKARGS --error-rate ${BENCH_ERRORS:-0} --fail-rate ${BENCH_FAILURES:-0}"
+if [ "${BENCH_TLS:-0}" = 1 ]; then
+    openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj /CN=127.0.0.1 \
+        -keyout "$TMP/key.pem" -out "$TMP/cert.pem" >/dev/null 2>&1 ||
+        { echo "openssl is needed for BENCH_TLS=1" >&2; exit 1; }
+    SCHEME=https
+    MOCKARGS="$MOCKARGS --cert $TMP/cert.pem --key $TMP/key.pem"
+fi
+
+python3 "$DIR/mockprov.py" $MOCKARGS &
+MOCK=$!
+i=0
+while ! curl -ks "$SCHEME://127.0.0.1:$PORT/_stats" >/dev/null 2>&1; do
+    i=$((i + 1))
+    [ $i -gt 50 ] && { echo "mock provider did not start" >&2; exit 1; }
+    sleep 0.1
+done
+
+mkdir "$TMP/state" || exit 1
+set -- -d "$TMP/state" -u "$SCHEME://127.0.0.1:$PORT" -n "${BENCH_HOSTS:-100}" \
+    -c "${BENCH_CYCLES:-5}" -p "${BENCH_PROVIDERS:-dyndns,namecheap,he,tunnel}" \
+    -s "127.0.0.1:$STUN_PORT"
+[ "${BENCH_IPV6:-0}" = 1 ] && set -- "$@" -6
+if command -v strace >/dev/null 2>&1; then
+    strace -f -c -o "$TMP/strace" "$BIN" "$@" || exit 1
+    awk '$NF == "total" { print "syscalls: " $4 " (all cycles)" }' "$TMP/strace"
+else
+    "$BIN" "$@" || exit 1
+    echo "syscalls: strace not found"
+fi
+echo "mock provider: $(curl -ks "$SCHEME://127.0.0.1:$PORT/_stats")"
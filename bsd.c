@@ -41,13 +41,13 @@
 #include "log.h"
 #include "strl.h"
 #include "util.h"
+#include "arena.h"
 
-/* allocates from heap for return */
+/* allocates from the cycle arena for return */
 char *get_interface_ip(char *ifname)
 {
     struct ifaddrs *ifp = NULL, *p = NULL;
     char *ret = NULL, *ip;
-    size_t len;
     int r, found = 0;
 
     if (ifname == NULL)
@@ -83,9 +83,7 @@ char *get_interface_ip(char *ifname)
     }
 
     ip = inet_ntoa(((struct sockaddr_in *)p->ifa_addr)->sin_addr);
-    len = strlen(ip) + 1;
-    ret = xmalloc(len);
-    strnkcpy(ret, ip, len);
+    ret = arena_strdup(ip);
 
 out2:
     freeifaddrs(ifp);
@@ -93,3 +91,50 @@ out:
     return ret;
 }
 
+/* allocates from the cycle arena for return; the first global IPv6
+ * address on ifname, or NULL if it has none */
+char *get_interface_ip6(char *ifname)
+{
+    struct ifaddrs *ifp = NULL, *p;
+    struct in6_addr *a;
+    char buf[INET6_ADDRSTRLEN], *ret = NULL;
+
+    if (ifname == NULL)
+        return NULL;
+
+    if (getifaddrs(&ifp)) {
+        log_line("Failed to interface address info.");
+        return NULL;
+    }
+
+    for (p = ifp; p; p = p->ifa_next) {
+        if (!p->ifa_name || strcmp(ifname, p->ifa_name) || !p->ifa_addr ||
+            p->ifa_addr->sa_family != AF_INET6)
+            continue;
+        a = &((struct sockaddr_in6 *)p->ifa_addr)->sin6_addr;
+        if (!ip6_is_global(a))
+            continue;
+        if (inet_ntop(AF_INET6, a, buf, sizeof buf)) {
+            ret = arena_strdup(buf);
+            break;
+        }
+    }
+    if (!ret)
+        log_line("Could not find a global IPv6 address for [%s].", ifname);
+
+    freeifaddrs(ifp);
+    return ret;
+}
+
+/* No change notification mechanism; callers fall back to polling. */
+int ifchange_open(void)
+{
+    return -1;
+}
+
+char *ifchange_read(int fd, char **ifnames)
+{
+    (void)fd;
+    (void)ifnames;
+    return NULL;
+}
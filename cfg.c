@@ -27,8 +27,13 @@
  */
 
 #include <string.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
 #include <netdb.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -42,91 +47,90 @@
 #include "chroot.h"
 #include "malloc.h"
 #include "ndyndns.h"
-
-#include "dns_dyn.h"
-#include "dns_nc.h"
-#include "dns_he.h"
+#include "state.h"
+#include "resolve.h"
+#include "checkip.h"
+#include "metrics.h"
+#include "source.h"
+#include "stun.h"
+#include "dnscheck.h"
+#include "cfgsnap.h"
+#include "control.h"
+#include "urlbuf.h"
+#include "provider.h"
+
+/* Path of the configuration file, for reloads; NULL if it was read from
+ * stdin or lies outside of the chroot. */
+static char *config_path;
+
+/* Set while the running configuration is reloaded: errors in the file then
+ * abandon the reload rather than being fatal. */
+static int reloading, reload_bad;
 
 void init_config()
 {
-    init_dyndns_conf();
-    init_namecheap_conf();
-    init_he_conf();
+    providers_init();
 }
 
-void remove_host_from_hostdata_list(hostdata_t **phl, char *host)
+static void cfg_error(const char *fmt, ...)
 {
-    hostdata_t *cur = *phl, *after = NULL, *p;
-
-    if (!strcmp(cur->host, host)) {
-        after = cur->next;
-        free(cur->host);
-        free(cur->ip);
-        free(cur);
-        *phl = after;
-    }
-    for (; cur->next != NULL; cur = cur->next) {
-        p = cur->next;
-        if(!strcmp(p->host, host)) {
-            after = p->next;
-            free(p->host);
-            free(p->ip);
-            free(p);
-            p = after;
-        }
-    }
+    char buf[MAX_BUF];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof buf, fmt, ap);
+    va_end(ap);
+    if (!reloading)
+        suicide("%s  Exiting.", buf);
+    log_line("%s", buf);
+    reload_bad = 1;
 }
 
 /* allocates memory for return or returns NULL; returns error string
  * or NULL if the host is OK to update. */
 static char *get_dnserr(char *host)
 {
-    FILE *f;
-    char buf[MAX_BUF], *file, *ret = NULL;
-    int len;
+    state_rec_t *r;
 
     if (!host)
         suicide("%s: host is NULL", __func__);
 
-    memset(buf, '\0', MAX_BUF);
-
-    len = strlen(get_chroot()) + strlen(host) + strlen("-dnserr") + 6;
-    file = xmalloc(len);
-    strnkcpy(file, get_chroot(), len);
-    strnkcat(file, "/var/", len);
-    strnkcat(file, host, len);
-    strnkcat(file, "-dnserr", len);
-
-    f = fopen(file, "r");
-    free(file);
+    r = state_lookup(host);
+    if (!r || !r->err)
+        return NULL;
+    return strdup(r->err);
+}
 
-    if (!f)
-        goto out;
 
-    if (!fgets(buf, sizeof buf, f)) {
-        log_line("%s-dnserr is empty.  Assuming error: [unknown].", host);
-        ret = xmalloc(sizeof "unknown" + 1);
-        strnkcpy(ret, "unknown", sizeof "unknown" + 1);
-        goto outfd;
+static void append_host(hostlist_t *list, hostdata_t *item)
+{
+    if (hostlist_append(list, item)) {
+        log_line("[%s] is listed more than once.  Ignoring the duplicate.",
+                 item->host);
+        free(item->host);
+        free(item->password);
+        free(item->ip);
+        free(item->ip6);
+        free(item);
     }
-
-    len = strlen(buf) + 1;
-    ret = xmalloc(len);
-    strnkcpy(ret, buf, len);
-outfd:
-    fclose(f);
-out:
-    return ret;
 }
 
+/* allocates memory for return or returns NULL */
+static char *get_dnsip6(char *host)
+{
+    state_rec_t *r = state_lookup(host);
+
+    if (!r || !r->ip6)
+        return NULL;
+    return addr_dup(r->ip6);
+}
 
 /* allocates memory.  ip may be NULL */
-static void add_to_hostdata_list(hostdata_t **list, char *host, char *ip,
-                    time_t time)
+static void add_to_hostdata_list(hostlist_t *list, char *host,
+                                 source_t *src, char *ip, time_t time)
 {
-    hostdata_t *item, *t;
-    char *elem, *err = NULL;
-    size_t len;
+    hostdata_t *item;
+    char *err = NULL;
 
     if (!list || !host) return;
 
@@ -137,57 +141,27 @@ static void add_to_hostdata_list(hostdata_t **list, char *host, char *ip,
         return;
     }
 
-    item = xmalloc(sizeof (hostdata_t));
-    item->date = time;
-    item->next = NULL;
-    item->ip = NULL;
-
-    len = strlen(host) + 1;
-    elem = xmalloc(len);
-    strnkcpy(elem, host, len);
-    item->host = elem;
-
-    if (!ip || !item->host) {
-        if (item->host) {
-            log_line("[%s] has no ip address.  No updates will be performed for [%s].", host, host);
-        } else {
-            log_line("[%s] has no host name.  Your configuration file has a problem.", ip);
-        }
-        goto out;
-    }
-
-    len = strlen(ip) + 1;
-    elem = xmalloc(len);
-    strnkcpy(elem, ip, len);
-    item->ip = elem;
-
-    if (!*list) {
-        *list = item;
+    if (!ip) {
+        log_line("[%s] has no ip address.  No updates will be performed for [%s].", host, host);
         return;
     }
 
-    t = *list;
-    while (t) {
-        if (!t->next) {
-            t->next = item;
-            return;
-        }
-        t = t->next;
-    }
-    log_line("%s: coding error", __func__);
-out:
-    free(item->host);
-    free(item->ip);
-    free(item);
+    item = xmalloc(sizeof (hostdata_t));
+    memset(item, 0, sizeof *item);
+    item->date = time;
+    item->host = strdup(host);
+    item->ip = addr_dup(ip);
+    item->ip6 = get_dnsip6(host);
+    item->src = src;
+    append_host(list, item);
 }
 
 /* allocates memory.  ip may be NULL */
-static void add_to_hostpair_list(hostdata_t **list, char *host, char *passwd,
-                                 char *ip, time_t time)
+static void add_to_hostpair_list(hostlist_t *list, char *host, char *passwd,
+                                 source_t *src, char *ip, time_t time)
 {
-    hostdata_t *item, *t;
-    char *elem, *err = NULL;
-    size_t len;
+    hostdata_t *item;
+    char *err = NULL;
 
     if (!list || !host || !passwd) return;
 
@@ -198,813 +172,977 @@ static void add_to_hostpair_list(hostdata_t **list, char *host, char *passwd,
         return;
     }
 
-    item = xmalloc(sizeof (hostdata_t));
-    item->date = time;
-    item->next = NULL;
-    item->ip = NULL;
-
-    len = strlen(host) + 1;
-    elem = xmalloc(len);
-    strnkcpy(elem, host, len);
-    item->host = elem;
-
-    len = strlen(passwd) + 1;
-    elem = xmalloc(len);
-    strnkcpy(elem, passwd, len);
-    item->password = elem;
-
-    len = strlen(ip) + 1;
-    elem = xmalloc(len);
-    strnkcpy(elem, ip, len);
-    item->ip = elem;
-
     if (!ip) {
         log_line("[%s] has no ip address.  No updates will be performed for [%s].", host, host);
-        goto out;
-    } else if (!item->host) {
-        log_line("[%s] has no host name.  Your configuration file has a problem.", ip);
-        goto out;
-    } else if (!item->password) {
-        log_line("[%s] has no password.  Your configuration file has a problem.", ip);
-        goto out;
-    }
-
-    if (!*list) {
-        *list = item;
         return;
     }
 
-    t = *list;
-    while (t) {
-        if (!t->next) {
-            t->next = item;
-            return;
-        }
-        t = t->next;
-    }
-    log_line("%s: coding error", __func__);
-out:
-    free(item->host);
-    free(item->password);
-    free(item->ip);
-    free(item);
+    item = xmalloc(sizeof (hostdata_t));
+    memset(item, 0, sizeof *item);
+    item->date = time;
+    item->host = strdup(host);
+    item->password = strdup(passwd);
+    item->ip = addr_dup(ip);
+    item->ip6 = get_dnsip6(host);
+    item->src = src;
+    append_host(list, item);
 }
 
 static time_t get_dnsdate(char *host)
 {
-    FILE *f;
-    char buf[MAX_BUF], *file;
-    size_t len;
-    time_t ret = 0;
+    state_rec_t *r;
 
     if (!host)
         suicide("FATAL - get_dnsdate: host is NULL");
 
-    len = strlen(get_chroot()) + strlen(host) + strlen("-dnsdate") + 6;
-    file = xmalloc(len);
-    strnkcpy(file, get_chroot(), len);
-    strnkcat(file, "/var/", len);
-    strnkcat(file, host, len);
-    strnkcat(file, "-dnsdate", len);
+    r = state_lookup(host);
+    if (!r) {
+        log_line("No existing state for %s.  Assuming date == 0.", host);
+        return 0;
+    }
+    return r->date;
+}
 
-    f = fopen(file, "r");
-    free(file);
+/* allocates memory for return or returns NULL */
+static char *get_dnsip(char *host)
+{
+    state_rec_t *r;
 
-    if (!f) {
-        log_line("No existing %s-dnsdate.  Assuming date == 0.", host);
-        goto out;
+    if (!host)
+        suicide("%s: host is NULL", __func__);
+
+    r = state_lookup(host);
+    if (!r || !r->ip)
+        return NULL;
+    return strdup(r->ip);
+}
+
+/* Hosts that have no recorded ip; they are resolved together once the
+ * whole configuration has been read. */
+typedef struct {
+    hostlist_t *list;
+    char *host;
+    char *passwd;               /* NULL unless a hostpair */
+    source_t *src;
+} pending_host_t;
+
+static pending_host_t *pending;
+static size_t pending_count, pending_size;
+
+static void defer_host(hostlist_t *list, char *host, char *passwd,
+                       source_t *src)
+{
+    log_line("No existing ip for %s.  Querying DNS.", host);
+    if (pending_count == pending_size) {
+        pending_host_t *n;
+        pending_size = pending_size ? pending_size * 2 : 16;
+        n = xmalloc(pending_size * sizeof (pending_host_t));
+        if (pending_count)
+            memcpy(n, pending, pending_count * sizeof (pending_host_t));
+        free(pending);
+        pending = n;
     }
+    pending[pending_count].list = list;
+    pending[pending_count].host = strdup(host);
+    pending[pending_count].passwd = passwd ? strdup(passwd) : NULL;
+    pending[pending_count].src = src;
+    ++pending_count;
+}
 
-    if (!fgets(buf, sizeof buf, f)) {
-        log_line("%s-dnsdate is empty.  Assuming date == 0.", host);
-        goto outfd;
+static void hydrate_pending(void)
+{
+    resolve_req_t *reqs;
+    pending_host_t *p;
+    size_t i;
+
+    if (!pending_count)
+        return;
+    reqs = xmalloc(pending_count * sizeof *reqs);
+    for (i = 0; i < pending_count; ++i) {
+        reqs[i].name = pending[i].host;
+        reqs[i].ip = NULL;
     }
+    resolve_hosts(reqs, pending_count);
+
+    for (i = 0; i < pending_count; ++i) {
+        p = &pending[i];
+        if (reqs[i].ip) {
+            log_line("adding: [%s] ip: [%s]", p->host, reqs[i].ip);
+            if (p->passwd)
+                add_to_hostpair_list(p->list, p->host, p->passwd, p->src,
+                                     reqs[i].ip, get_dnsdate(p->host));
+            else
+                add_to_hostdata_list(p->list, p->host, p->src, reqs[i].ip,
+                                     get_dnsdate(p->host));
+        } else {
+            log_line("No ip found for [%s].  No updates will be done.",
+                     p->host);
+        }
+        free(reqs[i].ip);
+        free(p->host);
+        free(p->passwd);
+    }
+    free(reqs);
+    free(pending);
+    pending = NULL;
+    pending_count = pending_size = 0;
+}
 
-    ret = (time_t)atol(buf);
-    if (ret < 0)
-        ret = 0;
-outfd:
-    fclose(f);
-out:
-    return ret;
+/* Splits a trailing @source from host.  Returns the named source, or NULL
+ * if the host names none. */
+static source_t *split_source(char *host)
+{
+    char *at = strchr(host, '@');
+
+    if (!at)
+        return NULL;
+    *at++ = '\0';
+    if (!strlen(at)) {
+        cfg_error("host [%s] names an empty source.", host);
+        return NULL;
+    }
+    return source_get(at);
 }
 
-/* allocates memory for return or returns NULL */
-static char *lookup_dns(char *name) {
-    struct hostent *hent;
-    char *ret = NULL, *t = NULL;
-    int len;
-
-    if (!name)
-        suicide("%s: host is NULL!", __func__);
-
-    hent = gethostbyname(name);
-    if (hent == NULL) {
-        switch (h_errno) {
-        case HOST_NOT_FOUND:
-            log_line("failed to resolve %s: host not found.", name);
-            break;
-        case NO_ADDRESS:
-            log_line("failed to resolve %s: no IP for host.", name);
-            break;
-        case NO_RECOVERY:
-        default:
-            log_line("failed to resolve %s: non-recoverable error.", name);
-            break;
-        case TRY_AGAIN:
-            log_line("failed to resolve %s: temporary error on an authoritative nameserver.", name);
-            break;
-        }
-        goto out;
+/* Adds host to list with the address last published for it, or queues it
+ * to be resolved.  passwd is NULL unless list holds hostpairs. */
+static void populate(hostlist_t *list, char *host, char *passwd,
+                     source_t *src)
+{
+    char *ip = get_dnsip(host);
+
+    if (ip) {
+        log_line("adding: [%s] ip: [%s]", host, ip);
+        if (passwd)
+            add_to_hostpair_list(list, host, passwd, src, ip,
+                                 get_dnsdate(host));
+        else
+            add_to_hostdata_list(list, host, src, ip, get_dnsdate(host));
+    } else {
+        defer_host(list, host, passwd, src);
     }
+    free(ip);
+}
 
-    t = inet_ntoa(*((struct in_addr *)hent->h_addr));
-    log_line("%s: returned [%s]", __func__, t);
+/*
+ * Returns 1 if assignment made, 0 if not.
+ * Creates a new copy of @from on success.
+ */
+static int assign_string(char **to, char *from)
+{
+    int ret = 0;
+
+    if (from) {
+        if (*to)
+            free(*to);
+        *to = strdup(from);
+        ret = 1;
+    }
 
-    len = strlen(t) + 1;
-    ret = xmalloc(len);
-    strnkcpy(ret, t, len);
-out:
     return ret;
 }
 
-/* allocates memory for return or returns NULL */
-static char *get_dnsip(char *host)
-{
-    FILE *f;
-    char buf[MAX_BUF], *file, *ret = NULL;
-    int len;
-    struct in_addr inr;
+enum prs_state {
+    PRS_NONE,
+    PRS_CONFIG,
+    PRS_PROVIDER,
+    PRS_SOURCE,
+};
 
-    if (!host)
-        suicide("%s: host is NULL", __func__);
+enum key_kind {
+    KIND_SECTION,               /* matched as a prefix */
+    KIND_VALUE,                 /* key = value */
+    KIND_LIST,                  /* key = a, b, ... */
+    KIND_BARE,                  /* matched as a prefix */
+};
 
-    memset(buf, '\0', MAX_BUF);
+#define KEY(name, kind) { name, sizeof name - 1, kind }
+static const struct {
+    const char *name;
+    unsigned char len;
+    unsigned char kind;
+} cfg_keys[K_MAX] = {
+    [K_CONFIG_SECTION] = KEY("[config]", KIND_SECTION),
+    [K_DYNDNS_SECTION] = KEY("[dyndns]", KIND_SECTION),
+    [K_NAMECHEAP_SECTION] = KEY("[namecheap]", KIND_SECTION),
+    [K_HE_SECTION] = KEY("[he]", KIND_SECTION),
+    [K_SOURCE_SECTION] = KEY("[source", KIND_SECTION),
+    [K_SOURCE] = KEY("source", KIND_VALUE),
+    [K_ADDRESS] = KEY("address", KIND_VALUE),
+    [K_ADDRESS6] = KEY("address6", KIND_VALUE),
+    [K_PASSWORD] = KEY("password", KIND_VALUE),
+    [K_PASSHASH] = KEY("passhash", KIND_VALUE),
+    [K_HOSTS] = KEY("hosts", KIND_LIST),
+    [K_HOSTPAIRS] = KEY("hostpairs", KIND_LIST),
+    [K_TUNNELIDS] = KEY("tunnelids", KIND_LIST),
+    [K_USERNAME] = KEY("username", KIND_VALUE),
+    [K_USERID] = KEY("userid", KIND_VALUE),
+    [K_SERVER] = KEY("server", KIND_VALUE),
+    [K_TUNNELSERVER] = KEY("tunnelserver", KIND_VALUE),
+    [K_MX] = KEY("mx", KIND_VALUE),
+    [K_CHROOT] = KEY("chroot", KIND_VALUE),
+    [K_CHECKIP] = KEY("checkip", KIND_VALUE),
+    [K_CHECKIP6] = KEY("checkip6", KIND_VALUE),
+    [K_CHECKIP_QUORUM] = KEY("checkip-quorum", KIND_VALUE),
+    [K_STUNSERVER] = KEY("stunserver", KIND_VALUE),
+    [K_DNSSERVER] = KEY("dnsserver", KIND_VALUE),
+    [K_METRICS] = KEY("metrics", KIND_VALUE),
+    [K_CONTROL] = KEY("control", KIND_VALUE),
+    [K_PIDFILE] = KEY("pidfile", KIND_VALUE),
+    [K_USER] = KEY("user", KIND_VALUE),
+    [K_GROUP] = KEY("group", KIND_VALUE),
+    [K_INTERFACE] = KEY("interface", KIND_VALUE),
+    [K_NOWILDCARD] = KEY("nowildcard", KIND_BARE),
+    [K_WILDCARD] = KEY("wildcard", KIND_BARE),
+    [K_PRIMARYMX] = KEY("primarymx", KIND_BARE),
+    [K_BACKUPMX] = KEY("backupmx", KIND_BARE),
+    [K_OFFLINE] = KEY("offline", KIND_BARE),
+    [K_DYNDNS] = KEY("dyndns", KIND_BARE),
+    [K_CUSTOMDNS] = KEY("customdns", KIND_BARE),
+    [K_STATICDNS] = KEY("staticdns", KIND_BARE),
+    [K_DETACH] = KEY("detach", KIND_BARE),
+    [K_NODETACH] = KEY("nodetach", KIND_BARE),
+    [K_QUIET] = KEY("quiet", KIND_BARE),
+    [K_DISABLE_CHROOT] = KEY("disable-chroot", KIND_BARE),
+    [K_REMOTE] = KEY("remote", KIND_BARE),
+    [K_STUN] = KEY("stun", KIND_BARE),
+    [K_VERIFY] = KEY("verify", KIND_BARE),
+    [K_IPV6] = KEY("ipv6", KIND_BARE),
+    [K_SNAPSHOT] = KEY("snapshot", KIND_BARE),
+};
+#undef KEY
 
-    len = strlen(get_chroot()) + strlen(host) + strlen("-dnsip") + 6;
-    file = xmalloc(len);
-    strnkcpy(file, get_chroot(), len);
-    strnkcat(file, "/var/", len);
-    strnkcat(file, host, len);
-    strnkcat(file, "-dnsip", len);
+/* Returns the name given by a [source NAME] header, or NULL if the header
+ * is malformed.  point is modified. */
+static char *parse_source_header(char *point)
+{
+    char *name, *end;
+
+    name = point + cfg_keys[K_SOURCE_SECTION].len;
+    if (*name != ' ' && *name != '\t')
+        return NULL;
+    while (*name == ' ' || *name == '\t')
+        ++name;
+    end = strchr(name, ']');
+    if (!end)
+        return NULL;
+    while (end > name && (end[-1] == ' ' || end[-1] == '\t'))
+        --end;
+    if (end == name)
+        return NULL;
+    *end = '\0';
+    return name;
+}
 
-    f = fopen(file, "r");
-    free(file);
+/* If point holds key = value, stores the trimmed value in *val and returns
+ * nonzero.  point is modified. */
+static int parse_value(char *point, size_t keylen, char **val)
+{
+    char *end;
+    int foundeq = 0;
 
-    if (!f) {
-        log_line("No existing %s-dnsip.  Querying DNS.", host);
-        ret = lookup_dns(host);
-        goto out;
+    point += keylen;
+    while (*point == ' ' || *point == '\t' || *point == '=') {
+        if (*point == '=')
+            foundeq = 1;
+        ++point;
     }
+    if (!foundeq)
+        return 0;
+    end = point + strlen(point);
+    while (end > point && (end[-1] == ' ' || end[-1] == '\t'))
+        --end;
+    *end = '\0';
+    *val = point;
+    return 1;
+}
+
+/* Identifies the statement at point, storing its value (or "") in *val.
+ * Returns K_MAX if point holds none.  point is modified. */
+static unsigned int parse_key(char *point, char **val, unsigned int lnum)
+{
+    unsigned int k;
+    size_t n;
 
-    if (!fgets(buf, sizeof buf, f)) {
-        log_line("%s-dnsip is empty.  Querying DNS.", host);
-        ret = lookup_dns(host);
-        goto outfd;
+    *val = point + strlen(point);
+    for (k = 0; k < K_MAX; ++k) {
+        if (cfg_keys[k].kind != KIND_SECTION ||
+            strncmp(point, cfg_keys[k].name, cfg_keys[k].len))
+            continue;
+        if (k == K_SOURCE_SECTION) {
+            *val = parse_source_header(point);
+            if (!*val) {
+                cfg_error("line %d: malformed source section header.", lnum);
+                return K_MAX;
+            }
+        }
+        return k;
     }
 
-    if (inet_aton(buf, &inr) == 0) {
-        log_line("%s-dnsip is corrupt.  Querying DNS.", host);
-        ret = lookup_dns(host);
-        goto outfd;
+    n = strcspn(point, " \t=");
+    for (k = 0; k < K_MAX; ++k) {
+        if ((cfg_keys[k].kind != KIND_VALUE && cfg_keys[k].kind != KIND_LIST)
+            || cfg_keys[k].len != n || memcmp(point, cfg_keys[k].name, n))
+            continue;
+        if (parse_value(point, n, val))
+            return k;
+        break;
     }
 
-    len = strlen(buf) + 1;
-    ret = xmalloc(len);
-    strnkcpy(ret, buf, len);
-outfd:
-    fclose(f);
-out:
-    return ret;
+    for (k = 0; k < K_MAX; ++k) {
+        if (cfg_keys[k].kind == KIND_BARE &&
+            !strncmp(point, cfg_keys[k].name, cfg_keys[k].len))
+            return k;
+    }
+    return K_MAX;
 }
 
-typedef void (*do_populate_fn)(hostdata_t **list, char *instr);
-
-static void do_populate(hostdata_t **list, char *host_in)
+/* Hands each entry of the comma-separated list p to fn; anything after a
+ * space or tab within an entry is ignored.  An empty list is handed over
+ * as a single empty entry.  p is modified. */
+static void split_list(char *p, unsigned int key, unsigned int lnum,
+                       cfgsnap_fn fn, void *arg)
 {
-    char *ip, *host, *host_orig;
-
-    host = strdup(host_in);
-    host_orig = host;
-    while (*host == ' ' || *host == '\t')
-        ++host;
-
-    if (strlen(host)) {
-        ip = get_dnsip(host);
-        if (ip) {
-            log_line("adding: [%s] ip: [%s]", host, ip);
-            add_to_hostdata_list(list, host, ip, get_dnsdate(host));
-        } else {
-            log_line("No ip found for [%s].  No updates will be done.", host);
+    char *tok, *end;
+    int n = 0;
+
+    while (*p) {
+        p += strspn(p, " \t");
+        tok = p;
+        end = tok + strcspn(tok, " \t,");
+        p = end + strcspn(end, ",");
+        if (*p)
+            ++p;
+        *end = '\0';
+        if (*tok) {
+            fn(arg, key, tok, lnum);
+            ++n;
         }
-        free(ip);
     }
-    free(host_orig);
+    if (!n)
+        fn(arg, key, p, lnum);
 }
 
-static void do_populate_hp(hostdata_t **list, char *pair_in)
+/* Reads the statements of the len bytes of configuration text in buf,
+ * which must be NUL-terminated, and hands each to fn.  buf is modified. */
+static void parse_text(char *buf, size_t len, cfgsnap_fn fn, void *arg)
 {
-    char *ip, *host, *host_orig, *passwd;
+    char *line, *next, *end = buf + len, *val;
+    unsigned int lnum = 0, k;
 
-    host = strdup(pair_in);
-    host_orig = host;
-    while (*host == ' ' || *host == '\t')
-        ++host;
-    passwd = host;
-    while (*passwd != ':' && *passwd != '\0')
-        ++passwd;
-    if (*passwd == ':') {
-        *passwd = '\0';
-        ++passwd;
-    }
+    for (line = buf; line < end; line = next) {
+        next = memchr(line, '\n', end - line);
+        if (next)
+            *next++ = '\0';
+        else
+            next = end;
+        ++lnum;
 
-    if (strlen(host) && strlen(passwd)) {
-        ip = get_dnsip(host);
-        if (ip) {
-            log_line("adding: [%s] ip: [%s]", host, ip);
-            add_to_hostpair_list(list, host, passwd, ip, get_dnsdate(host));
-        } else {
-            log_line("No ip found for [%s].  No updates will be done.", host);
-        }
-        free(ip);
+        null_crlf(line);
+        while (*line == ' ' || *line == '\t')
+            ++line;
+        k = parse_key(line, &val, lnum);
+        if (k == K_MAX)
+            continue;
+        if (cfg_keys[k].kind == KIND_LIST)
+            split_list(val, k, lnum, fn, arg);
+        else
+            fn(arg, k, val, lnum);
     }
-    free(host_orig);
 }
 
-static void populate_hostlist_generic(do_populate_fn fn, hostdata_t **list,
-                                      char *left)
+/* Binds every host that named no source to the section or default source,
+ * and marks the sources that hosts are bound to. */
+static void bind_sources(hostlist_t *list, source_t *src)
 {
-    char *right = (char *)1, *p;
+    hostgroup_t *g;
 
-    do {
-        right = strchr(left, ',');
-        if (right != NULL && left < right) {
-            for (p = left; p < right; ++p) {
-                if (*p == ' ' || *p == '\t')
-                    break;
-            }
-            size_t len = p - left + 1;
-            char *t = xmalloc(len);
-            memset(t, '\0', len);
-            memcpy(t, left, len - 1);
-            fn(list, t);
-            free(t);
-            left = right + 1;
-        } else {
-            fn(list, left);
-            break;
-        }
-    } while (1);
+    hostlist_bind_default(list, src ? src : source_default());
+    for (g = list->groups; g; g = g->next)
+        if (g->head)
+            g->src->used = 1;
 }
 
-static void populate_hostlist(hostdata_t **list, char *hostname)
+void parse_warn(unsigned int lnum, char *name)
 {
-    if (!list || !hostname)
-        suicide("%s: NULL passed as argument", __func__);
-    if (strlen(hostname) == 0)
-        suicide("No hosts were provided for updates.  Exiting.");
+    log_line("WARNING: config line %d: %s statement not valid in section", lnum, name);
+}
 
-    log_line("hosts: [%s]", hostname);
-    populate_hostlist_generic(do_populate, list, hostname);
+/* A host of a configuration that is being reloaded. */
+typedef struct staged {
+    hnode_t node;               /* keyed by host */
+    char *host;
+    char *passwd;               /* NULL unless a hostpair */
+    source_t *src;              /* NULL if it named none */
+    int live;                   /* is in the running configuration */
+    struct staged *next;
+} staged_t;
+
+typedef struct {
+    htab_t index;
+    staged_t *head;
+    staged_t **tail;
+} stage_t;
+
+typedef struct {
+    enum prs_state prs;
+    unsigned int section;       /* K_ header of the provider section */
+    source_t *src;              /* of the current [source] section */
+    source_t *list_src[PROV_MAX]; /* named by a source = line, or NULL */
+    void *conf[PROV_MAX];       /* that provider statements set */
+    int reload;                 /* stage hosts rather than adding them */
+    stage_t stage[PROV_MAX];
+    urlbuf_t fixed;             /* [config] and [source] statements */
+    int snapshot;               /* a snapshot line was seen */
+    int loaded;                 /* 0 if read from the snapshot */
+    char snap[PATH_MAX];        /* path of the snapshot, or "" */
+    uint64_t hash;              /* of the text */
+    size_t srclen;
+    urlbuf_t body;              /* statements for the snapshot */
+    unsigned int count;
+} parse_ctx_t;
+
+/* [config] and [source] statements of the running configuration, which a
+ * reload does not change. */
+static urlbuf_t fixed_stmts;
+
+static void stage_host(stage_t *st, char *host, char *passwd, source_t *src)
+{
+    staged_t *s;
+
+    if (htab_find(&st->index, host)) {
+        log_line("[%s] is listed more than once.  Ignoring the duplicate.",
+                 host);
+        return;
+    }
+    s = xmalloc(sizeof (staged_t));
+    memset(s, 0, sizeof *s);
+    s->host = strdup(host);
+    s->passwd = passwd ? strdup(passwd) : NULL;
+    s->src = src;
+    s->node.key = s->host;
+    htab_insert(&st->index, &s->node);
+    if (!st->tail)
+        st->tail = &st->head;
+    *st->tail = s;
+    st->tail = &s->next;
 }
 
-static void populate_hostpairs(hostdata_t **list, char *hostpair)
+static void free_stage(stage_t *st)
 {
-    if (!list || !hostpair)
-        suicide("%s: NULL passed as argument", __func__);
-    if (strlen(hostpair) == 0)
-        suicide("No hostpairs were provided for updates.  Exiting.");
-    log_line("hostpairs: [%s]", hostpair);
-    populate_hostlist_generic(do_populate_hp, list, hostpair);
+    staged_t *s, *next;
+
+    for (s = st->head; s; s = next) {
+        next = s->next;
+        free(s->host);
+        free(s->passwd);
+        free(s);
+    }
+    free(st->index.buckets);
+    memset(st, 0, sizeof *st);
 }
 
-/* returns 1 for valid config, 0 for invalid */
-static int validate_dyndns_conf(dyndns_conf_t *t)
+/* Takes the host, or the host:password pair if pair is set, in val for the
+ * list of provider idx.  val is modified. */
+static void take_host(parse_ctx_t *c, int idx, char *val, int pair)
 {
-    int r = 1;
-    if (t->username || t->password || t->hostlist) {
-        if (t->username == NULL) {
-            r = 0;
-            log_line("dyndns config invalid: no username provided");
-        }
-        if (t->password == NULL) {
-            r = 0;
-            log_line("dyndns config invalid: no password provided");
-        }
-        if (t->hostlist == NULL) {
-            r = 0;
-            log_line("dyndns config invalid: no hostnames provided");
-        }
+    char *passwd = NULL;
+    source_t *src;
+
+    if (pair) {
+        passwd = strchr(val, ':');
+        if (passwd)
+            *passwd++ = '\0';
+        else
+            passwd = "";
     }
-    return r;
+    src = split_source(val);
+
+    if (!strlen(val) || (passwd && !strlen(passwd)))
+        return;
+    if (c->reload)
+        stage_host(&c->stage[idx], val, passwd, src);
+    else
+        populate(providers[idx]->list, val, passwd, src);
 }
 
-/* returns 1 for valid config, 0 for invalid */
-static int validate_nc_conf(namecheap_conf_t *t)
+/* Applies statement key of a provider section to the providers that the
+ * section configures.  Returns 0 if none of them takes it.  val is
+ * modified. */
+static int apply_provider_stmt(parse_ctx_t *c, unsigned int key, char *val)
 {
-    int r = 1;
-    if (t->password || t->hostlist) {
-        if (t->password == NULL) {
-            r = 0;
-            log_line("namecheap config invalid: no password provided");
+    const provider_key_t *pk;
+    char *field;
+    int i, taken = 0;
+
+    for (i = 0; i < PROV_MAX; ++i) {
+        if (providers[i]->section != c->section)
+            continue;
+        if (key == K_SOURCE) {
+            c->list_src[i] = source_get(val);
+            taken = 1;
+            continue;
         }
-        if (t->hostlist == NULL) {
-            r = 0;
-            log_line("namecheap config invalid: no hostnames provided");
+        for (pk = providers[i]->keys; pk->key != K_MAX; ++pk)
+            if (pk->key == key)
+                break;
+        if (pk->key == K_MAX)
+            continue;
+        field = (char *)c->conf[i] + pk->off;
+        switch (pk->type) {
+        case PK_STRING: assign_string((char **)field, val); return 1;
+        case PK_FLAG: *(int *)field = pk->flag; return 1;
+        case PK_HOSTS:
+        case PK_HOSTPAIRS:
+            if (!*val) {
+                cfg_error("No %s were provided for updates.",
+                          pk->type == PK_HOSTPAIRS ? "hostpairs" : "hosts");
+                return 1;
+            }
+            take_host(c, i, val, pk->type == PK_HOSTPAIRS);
+            return 1;
         }
     }
-    return r;
+    return taken;
 }
 
-/* returns 1 for valid config, 0 for invalid */
-static int validate_he_conf(he_conf_t *t)
+/* Applies one statement.  val is modified. */
+static void apply_stmt(void *arg, unsigned int key, char *val,
+                       unsigned int lnum)
 {
-    int r = 1;
-    if (t->tunlist == NULL && t->hostpairs == NULL) {
-        r = 0;
-        log_line("he config invalid: no tunnelids or hostpairs provided");
-    } else if (t->tunlist) {
-        if (t->userid == NULL) {
-            r = 0;
-            log_line("he config invalid: no userid provided");
+    parse_ctx_t *c = arg;
+    source_t *src = c->src;
+
+    if (key == K_CONFIG_SECTION || key == K_SOURCE_SECTION ||
+        (cfg_keys[key].kind != KIND_SECTION &&
+         (c->prs == PRS_CONFIG || c->prs == PRS_SOURCE)))
+        cfgsnap_add(&c->fixed, key, val, strlen(val), 0);
+
+    switch (key) {
+    case K_CONFIG_SECTION:
+        c->prs = PRS_CONFIG;
+        return;
+    case K_SOURCE_SECTION:
+        c->prs = PRS_SOURCE;
+        c->src = NULL;
+        if (c->reload)
+            return;
+        src = source_get(val);
+        if (src == source_default()) {
+            cfg_error("line %d: the source name [%s] is reserved.", lnum,
+                      src->name);
+            return;
         }
-        if (t->passhash == NULL) {
-            r = 0;
-            log_line("he config invalid: no passhash provided");
+        src->defined = 1;
+        c->src = src;
+        return;
+    }
+
+    if (cfg_keys[key].kind == KIND_SECTION) {
+        c->prs = PRS_PROVIDER;
+        c->section = key;
+        return;
+    }
+
+    switch (c->prs) {
+    case PRS_PROVIDER:
+        if (apply_provider_stmt(c, key, val))
+            return;
+        break;
+    case PRS_CONFIG:
+        if (key == K_SNAPSHOT) {
+            c->snapshot = 1;
+            return;
+        }
+        if (c->reload)
+            return;
+        switch (key) {
+        case K_CHROOT: update_chroot(val); return;
+        case K_CHECKIP: checkip_add_url(val); return;
+        case K_CHECKIP6: checkip6_add_url(val); return;
+        case K_CHECKIP_QUORUM: checkip_set_quorum(atoi(val)); return;
+        case K_STUNSERVER: stun_add_server(val); return;
+        case K_DNSSERVER: dnscheck_add_server(val); return;
+        case K_METRICS: metrics_set_path(val); return;
+        case K_CONTROL: control_set_path(val); return;
+        case K_PIDFILE: cfg_set_pidfile(val); return;
+        case K_USER: cfg_set_user(val); return;
+        case K_GROUP: cfg_set_group(val); return;
+        case K_INTERFACE: cfg_set_interface(val); return;
+        case K_DETACH:
+        case K_NODETACH:
+        case K_QUIET:
+        case K_DISABLE_CHROOT:
+        case K_REMOTE:
+            return;
+        case K_STUN: source_default()->kind = SRC_STUN; return;
+        case K_VERIFY: dnscheck_enable(); return;
+        case K_IPV6: cfg_set_ipv6(); return;
         }
+        break;
+    case PRS_SOURCE:
+        if (c->reload || !src)
+            return;
+        switch (key) {
+        case K_ADDRESS:
+            src->kind = SRC_STATIC;
+            assign_string(&src->addr4, val);
+            return;
+        case K_ADDRESS6:
+            src->kind = SRC_STATIC;
+            assign_string(&src->addr6, val);
+            return;
+        case K_INTERFACE:
+            strnkcpy(src->ifname, val, sizeof src->ifname);
+            src->bind = 1;
+            return;
+        case K_REMOTE: src->kind = SRC_REMOTE; return;
+        case K_STUN: src->kind = SRC_STUN; return;
+        case K_IPV6: src->ipv6 = 1; return;
+        }
+        break;
+    default:
+        break;
     }
-    return r;
+    parse_warn(lnum, (char *)cfg_keys[key].name);
 }
 
-static char *parse_line_string(char *line, char *key)
+/* Records a statement read from the text for the snapshot, then applies
+ * it. */
+static void record_stmt(void *arg, unsigned int key, char *val,
+                        unsigned int lnum)
 {
-    char *point = NULL, *ret = NULL;
-    int len, foundeq = 0;
+    parse_ctx_t *c = arg;
 
-    null_crlf(line);
-    point = line;
-    if (strncmp(point, key, strlen(key)))
-        goto out;
+    cfgsnap_add(&c->body, key, val, strlen(val), lnum);
+    ++c->count;
+    apply_stmt(arg, key, val, lnum);
+}
 
-    point += strlen(key);
-    while (1) {
-        if (*point == ' ' || *point == '\t') {
-            ++point;
-        } else if (*point == '=') {
-            foundeq = 1;
-            ++point;
-        } else {
-            break;
+/* Returns the whole of file, or of stdin if file is NULL, NUL-terminated,
+ * or NULL if it cannot be read; its length is stored in *len. */
+static char *read_config(char *file, size_t *len)
+{
+    char *buf;
+    size_t size = MAX_BUF, n = 0;
+    ssize_t r;
+    int fd = 0;
+
+    if (file) {
+        fd = open(file, O_RDONLY);
+        if (fd == -1) {
+            cfg_error("%s: failed to open [%s] for read", __func__, file);
+            return NULL;
         }
     }
-    if (!foundeq)
-        goto out;
-    len = strlen(point);
-    while (1) {
-        if (*(point+len-1) == ' ' || *(point+len-1) == '\t') {
-            if (len - 1 >= 0)
-                *(point+len-1) = '\0';
-            if (len > 0)
-                --len;
-            else
-                break;
+    buf = xmalloc(size);
+    for (;;) {
+        if (n + 1 == size) {
+            char *nb = xmalloc(size * 2);
+            memcpy(nb, buf, n);
+            free(buf);
+            buf = nb;
+            size *= 2;
         }
-        else
+        r = read(fd, buf + n, size - n - 1);
+        if (r == 0)
             break;
+        if (r == -1) {
+            if (errno == EINTR)
+                continue;
+            cfg_error("%s: failed to read [%s]", __func__,
+                      file ? file : "stdin");
+            if (file)
+                close(fd);
+            free(buf);
+            return NULL;
+        }
+        n += r;
     }
-    ret = xmalloc(len + 1);
-    strnkcpy(ret, point, len + 1);
-out:
-    return ret;
+    if (file && close(fd))
+        cfg_error("%s: failed to close [%s]", __func__, file);
+    buf[n] = '\0';
+    *len = n;
+    return buf;
 }
 
-/*
- * Returns 1 if assignment made, 0 if not.
- * Creates a new copy of @from on success.
- */
-static int assign_string(char **to, char *from)
+/* Applies the statements of file, or of stdin if file is NULL, taking them
+ * from its snapshot if that is current.  Returns -1 if the file could not
+ * be read. */
+static int parse_file(parse_ctx_t *c, char *file)
 {
-    int ret = 0;
+    char *text;
+    size_t len;
 
-    if (from) {
-        if (*to)
-            free(*to);
-        *to = strdup(from);
-        ret = 1;
+    text = read_config(file, &len);
+    if (!text)
+        return -1;
+    c->hash = cfgsnap_hash(text, len);
+    c->srclen = len;
+    c->loaded = -1;
+    if (file) {
+        snprintf(c->snap, sizeof c->snap, "%s.snap", file);
+        c->loaded = cfgsnap_load(c->snap, c->hash, len, K_MAX, apply_stmt, c);
     }
-
-    return ret;
+    if (c->loaded)
+        parse_text(text, len, record_stmt, c);
+    free(text);
+    return 0;
 }
 
-enum prs_state {
-    PRS_NONE,
-    PRS_CONFIG,
-    PRS_DYNDNS,
-    PRS_NAMECHEAP,
-    PRS_HE,
-};
-
-#define PRS_CONFIG_STR "[config]"
-#define PRS_DYNDNS_STR "[dyndns]"
-#define PRS_NAMECHEAP_STR "[namecheap]"
-#define PRS_HE_STR "[he]"
-#define NOWILDCARD_STR "nowildcard"
-#define WILDCARD_STR "wildcard"
-#define PRIMARYMX_STR "primarymx"
-#define BACKUPMX_STR "backupmx"
-#define OFFLINE_STR "offline"
-#define DYNDNS_STR "dyndns"
-#define CUSTOMDNS_STR "customdns"
-#define STATICDNS_STR "staticdns"
-#define DETACH_STR "detach"
-#define NODETACH_STR "nodetach"
-#define QUIET_STR "quiet"
-#define DISABLE_CHROOT_STR "disable-chroot"
-#define REMOTE_STR "remote"
+/* Saves the statements that were read from the text as its snapshot once
+ * they are known to be valid, or removes a snapshot that is not wanted. */
+static void update_snapshot(parse_ctx_t *c, int valid)
+{
+    if (!c->snap[0] || !c->loaded)
+        return;
+    if (c->snapshot && valid)
+        cfgsnap_save(c->snap, c->hash, c->srclen, &c->body, c->count);
+    else if (!c->snapshot && unlink(c->snap) == 0)
+        log_line("Removed config snapshot [%s].", c->snap);
+}
 
-void parse_warn(unsigned int lnum, char *name)
+/* Returns 1 if conf is usable by provider idx, 0 if not; hosts is nonzero
+ * if the provider has any.  Providers without a validate() only use hosts
+ * that carry their own credentials, and are usable once they have some. */
+static int validate_provider(int idx, void *conf, int hosts)
 {
-    log_line("WARNING: config line %d: %s statement not valid in section", lnum, name);
+    provider_t *p = providers[idx];
+
+    return p->validate ? p->validate(conf, hosts) : hosts;
 }
 
 /* if file is NULL, then read stdin */
 int parse_config(char *file)
 {
-    FILE *f;
-    char buf[MAX_BUF];
-    int ret = -1;
-    unsigned int lnum = 0;
-    char *point, *tmp;
-    enum prs_state prs = PRS_NONE;
+    parse_ctx_t c;
+    int i, ret;
+
+    memset(&c, 0, sizeof c);
+    for (i = 0; i < PROV_MAX; ++i)
+        c.conf[i] = providers[i]->conf;
+    parse_file(&c, file);
+
+    hydrate_pending();
+    for (i = 0; i < PROV_MAX; ++i)
+        bind_sources(providers[i]->list, c.list_src[i]);
+    source_validate();
+    ret = 0;
+    for (i = 0; i < PROV_MAX; ++i)
+        ret |= validate_provider(i, c.conf[i], !!providers[i]->list->head);
+    update_snapshot(&c, ret);
 
     if (file) {
-        f = fopen(file, "r");
-        if (!f)
-            suicide("%s: failed to open [%s] for read", __func__, file);
-    } else {
-        f = fdopen(0, "r");
-        if (!f)
-            suicide("%s: failed to open stdin for read", __func__);
+        config_path = realpath(file, NULL);
+        if (!config_path)
+            config_path = strdup(file);
     }
+    ub_free(&fixed_stmts);
+    fixed_stmts = c.fixed;
+    ub_free(&c.body);
+    return ret;
+}
 
-    while (!feof(f)) {
-        if (!fgets(buf, sizeof buf, f))
-            break;
-        ++lnum;
-
-        point = buf;
-        while (*point == ' ' || *point == '\t')
-            ++point;
-
-        if (!strncmp(PRS_CONFIG_STR, point, sizeof PRS_CONFIG_STR - 1)) {
-            prs = PRS_CONFIG;
-            continue;
-        }
-        if (!strncmp(PRS_DYNDNS_STR, point, sizeof PRS_DYNDNS_STR - 1)) {
-            prs = PRS_DYNDNS;
-            continue;
-        }
-        if (!strncmp(PRS_NAMECHEAP_STR, point, sizeof PRS_NAMECHEAP_STR - 1)) {
-            prs = PRS_NAMECHEAP;
-            continue;
-        }
-        if (!strncmp(PRS_HE_STR, point, sizeof PRS_HE_STR - 1)) {
-            prs = PRS_HE;
-            continue;
-        }
-
-        tmp = parse_line_string(point, "password");
-        if (tmp) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "password");
-                    break;
-                case PRS_DYNDNS:
-                    assign_string(&dyndns_conf.password, tmp);
-                    break;
-                case PRS_NAMECHEAP:
-                    assign_string(&namecheap_conf.password, tmp);
-                    break;
-            }
-            free(tmp);
-            continue;
-        }
-
-        tmp = parse_line_string(point, "passhash");
-        if (tmp) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "passhash");
-                    break;
-                case PRS_HE:
-                    assign_string(&he_conf.passhash, tmp);
-                    break;
-            }
-            free(tmp);
-            continue;
-        }
+/* Makes the path of the configuration file relative to root, where the
+ * daemon is about to be confined, so that it can still be reloaded. */
+void cfg_enter_chroot(char *root)
+{
+    char *r;
+    size_t n;
 
-        tmp = parse_line_string(point, "hosts");
-        if (tmp) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "hosts");
-                    break;
-                case PRS_DYNDNS:
-                    populate_hostlist(&dyndns_conf.hostlist, tmp);
-                    break;
-                case PRS_NAMECHEAP:
-                    populate_hostlist(&namecheap_conf.hostlist, tmp);
-                    break;
-            }
-            free(tmp);
-            continue;
-        }
+    if (!config_path)
+        return;
+    r = realpath(root, NULL);
+    n = r ? strlen(r) : 0;
+    while (n && r[n - 1] == '/')
+        --n;
+    if (r && !strncmp(config_path, r, n) && config_path[n] == '/') {
+        memmove(config_path, config_path + n, strlen(config_path + n) + 1);
+    } else {
+        log_line("[%s] is outside of the chroot and cannot be reloaded.",
+                 config_path);
+        free(config_path);
+        config_path = NULL;
+    }
+    free(r);
+}
 
-        tmp = parse_line_string(point, "hostpairs");
-        if (tmp) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "hostpairs");
-                    break;
-                case PRS_HE:
-                    populate_hostpairs(&he_conf.hostpairs, tmp);
-                    break;
-            }
-            free(tmp);
-            continue;
-        }
+/* Returns the source that a staged host of provider idx is bound to. */
+static source_t *stage_source(parse_ctx_t *c, int idx, staged_t *s)
+{
+    if (s->src)
+        return s->src;
+    return c->list_src[idx] ? c->list_src[idx] : source_default();
+}
 
-        tmp = parse_line_string(point, "tunnelids");
-        if (tmp) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "tunnelids");
-                    break;
-                case PRS_HE:
-                    populate_hostlist(&he_conf.tunlist, tmp);
-                    break;
-            }
-            free(tmp);
-            continue;
+/* Returns 0 if the staged configuration may replace the running one. */
+static int check_stage(parse_ctx_t *c)
+{
+    staged_t *s;
+    source_t *src;
+    int i, hosts = 0, ok = 0;
+
+    for (i = 0; i < PROV_MAX; ++i) {
+        for (s = c->stage[i].head; s; s = s->next, ++hosts) {
+            src = stage_source(c, i, s);
+            if (!src->used && source_check(src))
+                return -1;
         }
+    }
+    if (!hosts) {
+        log_line("The configuration lists no hosts.");
+        return -1;
+    }
+    for (i = 0; i < PROV_MAX; ++i)
+        ok |= validate_provider(i, c->conf[i], !!c->stage[i].head);
+    return ok ? 0 : -1;
+}
 
-        tmp = parse_line_string(point, "username");
-        if (tmp) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "username");
-                    break;
-                case PRS_DYNDNS:
-                    assign_string(&dyndns_conf.username, tmp);
-                    break;
-            }
-            free(tmp);
-            continue;
-        }
+/* Moves *from into *to, returning nonzero if they differed. */
+static int take_string(char **to, char **from)
+{
+    int changed = *to && *from ? strcmp(*to, *from) != 0 : *to != *from;
 
-        tmp = parse_line_string(point, "userid");
-        if (tmp) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "userid");
-                    break;
-                case PRS_HE:
-                    assign_string(&he_conf.userid, tmp);
-                    break;
-            }
-            free(tmp);
-            continue;
-        }
+    free(*to);
+    *to = *from;
+    *from = NULL;
+    return changed;
+}
 
-        tmp = parse_line_string(point, "mx");
-        if (tmp) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "mx");
-                    break;
-                case PRS_DYNDNS:
-                    assign_string(&dyndns_conf.mx, tmp);
-                    break;
-            }
-            free(tmp);
-            continue;
+/* Replaces the settings of provider idx with those in c.  The strings of
+ * c are taken over. */
+static void reload_settings(parse_ctx_t *c, int idx)
+{
+    provider_t *p = providers[idx];
+    const provider_key_t *pk;
+    char *live, *staged;
+    int changed = 0;
+
+    for (pk = p->keys; pk->key != K_MAX; ++pk) {
+        live = (char *)p->conf + pk->off;
+        staged = (char *)c->conf[idx] + pk->off;
+        if (pk->type == PK_STRING) {
+            changed |= take_string((char **)live, (char **)staged);
+        } else if (pk->type == PK_FLAG && *(int *)live != *(int *)staged) {
+            *(int *)live = *(int *)staged;
+            changed = 1;
         }
+    }
+    if (changed)
+        log_line("[%s] settings changed.", p->label);
+}
 
-        if (!strncmp(NOWILDCARD_STR, point, sizeof NOWILDCARD_STR - 1)) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "nowildcard");
-                    break;
-                case PRS_DYNDNS:
-                    dyndns_conf.wildcard = WC_NO;
-                    break;
-            }
-            continue;
-        }
-        if (!strncmp(WILDCARD_STR, point, sizeof WILDCARD_STR - 1)) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "wildcard");
-                    break;
-                case PRS_DYNDNS:
-                    dyndns_conf.wildcard = WC_YES;
-                    break;
-            }
-            continue;
-        }
-        if (!strncmp(PRIMARYMX_STR, point, sizeof PRIMARYMX_STR - 1)) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "primarymx");
-                    break;
-                case PRS_DYNDNS:
-                    dyndns_conf.backmx = BMX_NO;
-                    break;
-            }
-            continue;
-        }
-        if (!strncmp(BACKUPMX_STR, point, sizeof BACKUPMX_STR - 1)) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "backupmx");
-                    break;
-                case PRS_DYNDNS:
-                    dyndns_conf.backmx = BMX_YES;
-                    break;
-            }
-            continue;
-        }
-        if (!strncmp(OFFLINE_STR, point, sizeof OFFLINE_STR - 1)) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "offline");
-                    break;
-                case PRS_DYNDNS:
-                    dyndns_conf.offline = OFFLINE_YES;
-                    break;
-            }
-            continue;
-        }
-        if (!strncmp(DYNDNS_STR, point, sizeof DYNDNS_STR - 1)) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "dyndns");
-                    break;
-                case PRS_DYNDNS:
-                    dyndns_conf.system = SYSTEM_DYNDNS;
-                    break;
-            }
-            continue;
-        }
-        if (!strncmp(CUSTOMDNS_STR, point, sizeof CUSTOMDNS_STR - 1)) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "customdns");
-                    break;
-                case PRS_DYNDNS:
-                    dyndns_conf.system = SYSTEM_CUSTOMDNS;
-                    break;
-            }
-            continue;
-        }
-        if (!strncmp(STATICDNS_STR, point, sizeof STATICDNS_STR - 1)) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "staticdns");
-                    break;
-                case PRS_DYNDNS:
-                    dyndns_conf.system = SYSTEM_STATDNS;
-                    break;
-            }
-            continue;
-        }
+/* Frees a configuration of provider idx that was staged for a reload. */
+static void free_settings(parse_ctx_t *c, int idx)
+{
+    const provider_key_t *pk;
 
-        tmp = parse_line_string(point, "chroot");
-        if (tmp) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "chroot");
-                    break;
-                case PRS_CONFIG:
-                    update_chroot(tmp);
-                    break;
-            }
-            free(tmp);
-            continue;
-        }
+    if (!c->conf[idx])
+        return;
+    for (pk = providers[idx]->keys; pk->key != K_MAX; ++pk)
+        if (pk->type == PK_STRING)
+            free(*(char **)((char *)c->conf[idx] + pk->off));
+    free(c->conf[idx]);
+}
 
-        tmp = parse_line_string(point, "pidfile");
-        if (tmp) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "pidfile");
-                    break;
-                case PRS_CONFIG:
-                    cfg_set_pidfile(tmp);
-                    break;
-            }
-            free(tmp);
+/* Brings the list of provider idx in line with its staged hosts.  The
+ * hosts that stay keep their addresses, dates, retries and deadlines.
+ * Counts the hosts added, removed and changed in n. */
+static void reload_list(parse_ctx_t *c, int idx, unsigned int n[3])
+{
+    hostlist_t *l = providers[idx]->list;
+    hostdata_t *hd, *next;
+    staged_t *s;
+    source_t *src;
+
+    for (hd = l->head; hd; hd = next) {
+        next = hd->next;
+        s = (staged_t *)htab_find(&c->stage[idx].index, hd->host);
+        if (!s) {
+            log_line("removing: [%s]", hd->host);
+            hostlist_remove(l, hd);
+            ++n[1];
             continue;
         }
-
-        tmp = parse_line_string(point, "user");
-        if (tmp) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "user");
-                    break;
-                case PRS_CONFIG:
-                    cfg_set_user(tmp);
-                    break;
-            }
-            free(tmp);
-            continue;
+        s->live = 1;
+        src = stage_source(c, idx, s);
+        if (src != hd->src) {
+            log_line("[%s] now takes its address from source [%s].",
+                     hd->host, src->name);
+            hostlist_rebind(hd, src);
+            ++n[2];
         }
-
-        tmp = parse_line_string(point, "group");
-        if (tmp) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "group");
-                    break;
-                case PRS_CONFIG:
-                    cfg_set_group(tmp);
-                    break;
-            }
-            free(tmp);
-            continue;
+        if (s->passwd && strcmp(s->passwd, hd->password)) {
+            log_line("[%s] has a new password.", hd->host);
+            free(hd->password);
+            hd->password = s->passwd;
+            s->passwd = NULL;
+            ++n[2];
         }
-
-        tmp = parse_line_string(point, "interface");
-        if (tmp) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "interface");
-                    break;
-                case PRS_CONFIG:
-                    cfg_set_interface(tmp);
-                    break;
-            }
-            free(tmp);
+    }
+    for (s = c->stage[idx].head; s; s = s->next) {
+        if (s->live)
             continue;
-        }
+        populate(l, s->host, s->passwd, stage_source(c, idx, s));
+        ++n[0];
+    }
+}
 
-        if (!strncmp(DETACH_STR, point, sizeof DETACH_STR - 1)) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "detach");
-                    break;
-                case PRS_CONFIG:
-                    break;
-            }
-            continue;
-        }
-        if (!strncmp(NODETACH_STR, point, sizeof NODETACH_STR - 1)) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "nodetach");
-                    break;
-                case PRS_CONFIG:
-                    break;
-            }
-            continue;
-        }
-        if (!strncmp(QUIET_STR, point, sizeof QUIET_STR - 1)) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "quiet");
-                    break;
-                case PRS_CONFIG:
-                    break;
-            }
-            continue;
-        }
-        if (!strncmp(DISABLE_CHROOT_STR, point, sizeof DISABLE_CHROOT_STR - 1)) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "disable-chroot");
-                    break;
-                case PRS_CONFIG:
-                    break;
-            }
-            continue;
-        }
-        if (!strncmp(REMOTE_STR, point, sizeof REMOTE_STR - 1)) {
-            switch (prs) {
-                default:
-                    parse_warn(lnum, "remote");
-                    break;
-                case PRS_CONFIG:
-                    break;
-            }
-            continue;
-        }
+/* Reads the configuration file again and brings the running configuration
+ * in line with it.  Only the differences are applied: hosts are added,
+ * removed or rebound and provider settings replaced, while the hosts that
+ * stay keep all that is known about them.  [config] and [source] sections
+ * are not reloaded.  Returns 0 if the file was applied, or -1 if it was
+ * rejected and the running configuration kept. */
+int reload_config(void)
+{
+    parse_ctx_t c;
+    unsigned int n[3] = { 0, 0, 0 };
+    source_t *src;
+    int i, ret = -1;
+
+    if (!config_path) {
+        log_line("No configuration file to reload.");
+        return -1;
     }
+    log_line("Reloading [%s].", config_path);
 
-    if (fclose(f))
-        suicide("%s: failed to close [%s]", __func__, file);
-    ret = validate_dyndns_conf(&dyndns_conf) |
-        validate_nc_conf(&namecheap_conf) | validate_he_conf(&he_conf);
+    memset(&c, 0, sizeof c);
+    for (i = 0; i < PROV_MAX; ++i) {
+        c.conf[i] = xmalloc(providers[i]->conf_size);
+        providers[i]->init(c.conf[i]);
+    }
+    c.reload = 1;
+    reloading = 1;
+    reload_bad = 0;
+    if (parse_file(&c, config_path) || reload_bad || check_stage(&c)) {
+        log_line("Keeping the running configuration.");
+        goto out;
+    }
+    update_snapshot(&c, 1);
+    if (c.fixed.len != fixed_stmts.len ||
+        (c.fixed.len && memcmp(c.fixed.buf, fixed_stmts.buf, c.fixed.len)))
+        log_line("Changes to [config] and [source] take effect on restart.");
+
+    for (i = 0; i < PROV_MAX; ++i) {
+        reload_settings(&c, i);
+        reload_list(&c, i, n);
+    }
+    hydrate_pending();
+    for (src = source_first(); src; src = src->next)
+        src->used = 0;
+    for (i = 0; i < PROV_MAX; ++i)
+        bind_sources(providers[i]->list, c.list_src[i]);
+    log_line("Reloaded: %u hosts added, %u removed, %u changed.",
+             n[0], n[1], n[2]);
+    ret = 0;
+out:
+    reloading = 0;
+    for (i = 0; i < PROV_MAX; ++i) {
+        free_stage(&c.stage[i]);
+        free_settings(&c, i);
+    }
+    ub_free(&c.fixed);
+    ub_free(&c.body);
     return ret;
 }
@@ -40,18 +40,69 @@ wildcard|nowildcard (default: NOCHG)
 backmx|nobackmx (default: NOCHG)
 offline (default: NO)
 */
-#include <time.h>
+#include "hostlist.h"
 
-typedef struct {
-    char *host;
-    char *password;
-    char *ip;
-    time_t date;
-    void *next;
-} hostdata_t;
+/*
+ * The configuration is read as a list of statements: one per line, or one
+ * per entry of a host list.  The key numbers are part of the snapshot
+ * format, so CFGSNAP_VERSION must be bumped whenever they change.  The
+ * statements of provider sections are handled through the providers' key
+ * tables (see provider.h).
+ */
+enum cfg_key {
+    K_CONFIG_SECTION,
+    K_DYNDNS_SECTION,
+    K_NAMECHEAP_SECTION,
+    K_HE_SECTION,
+    K_SOURCE_SECTION,
+    K_SOURCE,
+    K_ADDRESS,
+    K_ADDRESS6,
+    K_PASSWORD,
+    K_PASSHASH,
+    K_HOSTS,
+    K_HOSTPAIRS,
+    K_TUNNELIDS,
+    K_USERNAME,
+    K_USERID,
+    K_SERVER,
+    K_TUNNELSERVER,
+    K_MX,
+    K_CHROOT,
+    K_CHECKIP,
+    K_CHECKIP6,
+    K_CHECKIP_QUORUM,
+    K_STUNSERVER,
+    K_DNSSERVER,
+    K_METRICS,
+    K_CONTROL,
+    K_PIDFILE,
+    K_USER,
+    K_GROUP,
+    K_INTERFACE,
+    K_NOWILDCARD,
+    K_WILDCARD,
+    K_PRIMARYMX,
+    K_BACKUPMX,
+    K_OFFLINE,
+    K_DYNDNS,
+    K_CUSTOMDNS,
+    K_STATICDNS,
+    K_DETACH,
+    K_NODETACH,
+    K_QUIET,
+    K_DISABLE_CHROOT,
+    K_REMOTE,
+    K_STUN,
+    K_VERIFY,
+    K_IPV6,
+    K_SNAPSHOT,
+    K_MAX
+};
 
 void init_config();
-void remove_host_from_hostdata_list(hostdata_t **phl, char *host);
 int parse_config(char *file);
+void cfg_enter_chroot(char *root);
+int reload_config(void);
 #endif
 
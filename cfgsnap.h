@@ -0,0 +1,50 @@
+/* cfgsnap.h - compiled snapshots of the configuration file
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef NDYNDNS_CFGSNAP_H_
+#define NDYNDNS_CFGSNAP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "urlbuf.h"
+
+/* Bump whenever the statement keys in cfg.c change. */
+#define CFGSNAP_VERSION 2
+
+typedef void (*cfgsnap_fn)(void *arg, unsigned int key, char *val,
+                           unsigned int lnum);
+
+uint64_t cfgsnap_hash(const char *buf, size_t len);
+void cfgsnap_add(urlbuf_t *b, unsigned int key, const char *val, size_t len,
+                 unsigned int lnum);
+void cfgsnap_save(const char *path, uint64_t hash, size_t srclen,
+                  urlbuf_t *body, unsigned int count);
+int cfgsnap_load(const char *path, uint64_t hash, size_t srclen,
+                 unsigned int nkeys, cfgsnap_fn fn, void *arg);
+
+#endif
@@ -32,60 +32,350 @@
 #include <string.h>
 #include <ctype.h>
 #include <sys/types.h>
+#include <time.h>
 #include <errno.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <curl/curl.h>
 
 #include "defines.h"
 #include "dns_helpers.h"
+#include "transport.h"
 #include "log.h"
 #include "strl.h"
 #include "util.h"
+#include "arena.h"
 #include "malloc.h"
 
-static time_t last_time = 0;
+#define CHECKIP_URL "http://checkip.dyndns.com"
 
-/* allocates from heap for return;
- * returns NULL if remote host fails to give ip
+/*
+ * Any number of checkip services can be configured for each address
+ * family.  A query races several of them at once, preferring those that
+ * have answered quickly and reliably before, and returns as soon as
+ * checkip_quorum of them agree; the rest are cancelled.  With the default
+ * quorum of one the fastest valid answer wins.  Whenever the endpoints
+ * still outstanding could no longer make up the quorum, because some
+ * failed or disagreed, the next best endpoint is brought in.
  */
-char *query_curip(void)
+typedef struct checkip_ep {
+    char *url;
+    double srtt;                /* smoothed latency, ms */
+    unsigned int fails;         /* consecutive failures */
+    unsigned long samples;      /* answers and lost races timed */
+    unsigned long bad;
+    struct checkip_ep *next;
+} checkip_ep_t;
+
+typedef struct {
+    checkip_ep_t *eps, *tail;
+} checkip_set_t;
+
+static checkip_set_t checkip4, checkip6;
+static int checkip_quorum = 1;
+
+typedef struct {
+    int found;
+    char ip[INET6_ADDRSTRLEN];
+    size_t len;
+} checkip_parse_t;
+
+static const char * const checkip_keys[] = { "Current IP Address:", NULL };
+
+/* Collects the address that follows the label, stopping at the first
+ * character that cannot be part of it. */
+static int checkip_feed(resp_t *r, const char *buf, size_t len)
 {
-    conn_data_t data;
-    char *ip = NULL, *ret = NULL, *p = NULL;
-    int len;
-    time_t now;
+    checkip_parse_t *c = r->arg;
+    size_t i = 0;
 
-    now = clock_time();
+    if (!c->found) {
+        if (resp_keys_scan(r, buf, len, &i) < 0)
+            return RESP_MORE;
+        c->found = 1;
+    }
+    for (; i < len; ++i) {
+        if (!c->len && isspace((unsigned char)buf[i]))
+            continue;
+        if (buf[i] != '.' && buf[i] != ':' && !isxdigit((unsigned char)buf[i]))
+            return RESP_DONE;
+        if (c->len >= sizeof c->ip - 1) {
+            c->len = 0;
+            return RESP_DONE;
+        }
+        c->ip[c->len++] = buf[i];
+    }
+    return len ? RESP_MORE : RESP_DONE;
+}
 
-    /* query no more than once every ten minutes */
-    if (now - last_time < 600)
-        return ret;
+static void checkip_add(checkip_set_t *set, char *url)
+{
+    checkip_ep_t *e = xmalloc(sizeof (checkip_ep_t));
 
-    data.buf = xmalloc(MAX_CHUNKS * CURL_MAX_WRITE_SIZE + 1);
-    memset(data.buf, '\0', MAX_CHUNKS * CURL_MAX_WRITE_SIZE + 1);
-    data.buflen = MAX_CHUNKS * CURL_MAX_WRITE_SIZE + 1;
-    data.idx = 0;
+    memset(e, 0, sizeof *e);
+    e->url = strdup(url);
+    if (set->tail)
+        set->tail->next = e;
+    else
+        set->eps = e;
+    set->tail = e;
+}
 
-    if (dyndns_curl_send("http://checkip.dyndns.com", &data, NULL)) {
-        log_line("Failed to get IP from remote host.");
-        goto out;
+void checkip_add_url(char *url)
+{
+    checkip_add(&checkip4, url);
+}
+
+void checkip6_add_url(char *url)
+{
+    checkip_add(&checkip6, url);
+}
+
+void checkip_set_quorum(int n)
+{
+    if (n < 1)
+        suicide("checkip-quorum must be at least 1.  Exiting.");
+    checkip_quorum = n;
+}
+
+/* Services that answer with nothing but the address are accepted too. */
+static void checkip_plain(checkip_parse_t *c, resp_t *resp)
+{
+    char *p = resp->head;
+    size_t n;
+
+    while (isspace((unsigned char)*p))
+        ++p;
+    n = strlen(p);
+    while (n && isspace((unsigned char)p[n - 1]))
+        --n;
+    if (!n || n >= sizeof c->ip)
+        return;
+    memcpy(c->ip, p, n);
+    c->len = n;
+}
+
+/* A raced query to one endpoint. */
+typedef struct probe {
+    xfer_t x;
+    resp_t resp;
+    checkip_parse_t c;
+    checkip_ep_t *ep;
+    struct race *race;
+    double t0;
+    int valid;                  /* c.ip holds a well formed address */
+} probe_t;
+
+typedef struct race {
+    probe_t *probes;            /* in order of preference */
+    size_t n, next;             /* probes, and the next one to start */
+    int inflight;
+    int quorum;
+    int af;
+    char *iface;
+    char *answer;               /* points into the deciding probe */
+} race_t;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* Lower is better.  Untried endpoints come first, in config order; after
+ * that each consecutive failure costs as much as a timed out query. */
+static double ep_score(checkip_ep_t *e)
+{
+    if (!e->samples && !e->bad)
+        return 0;
+    return e->srtt + e->fails * XFER_TIMEOUT * 1000.0;
+}
+
+static void ep_sample(checkip_ep_t *e, double ms)
+{
+    e->srtt = e->samples ? e->srtt + (ms - e->srtt) / 8 : ms;
+    ++e->samples;
+}
+
+static void ep_record(checkip_ep_t *e, int good, double ms)
+{
+    if (!good) {
+        ++e->bad;
+        ++e->fails;
+        return;
     }
-    last_time = clock_time();
-
-    ip = strstr(data.buf, "Current IP Address:");
-    if (!ip)
-        goto out;
-    ip += strlen("Current IP Address:");
-    for (; isspace(*ip); ++ip);
-
-    for (p = ip, len = 0; *p == '.' || isdigit(*p); ++p, ++len);
-    if (!len)
-        goto out;
-    ++len;
-
-    ret = xmalloc(len);
-    strnkcpy(ret, ip, len);
-out:
-    free(data.buf);
+    ep_sample(e, ms);
+    e->fails = 0;
+}
+
+/* Takes probe's answer, if any, from its response. */
+static void probe_parse(probe_t *p)
+{
+    unsigned char addr[sizeof (struct in6_addr)];
+
+    if (p->x.result != CURLE_OK || p->resp.status >= 400)
+        return;
+    if (!p->c.found)
+        checkip_plain(&p->c, &p->resp);
+    if (!p->c.len)
+        return;
+    p->c.ip[p->c.len] = '\0';
+    if (inet_pton(p->race->af, p->c.ip, addr) != 1) {
+        log_line("checkip: [%s] gave an invalid address: [%s]",
+                 p->ep->url, p->c.ip);
+        return;
+    }
+    p->valid = 1;
+}
+
+static void probe_start(xfer_t *x)
+{
+    probe_t *p = x->arg;
+
+    log_line("checkip url: [%s]", x->url);
+    p->t0 = now_ms();
+}
+
+static void probe_done(xfer_t *x);
+
+static void race_launch(race_t *r)
+{
+    probe_t *p = &r->probes[r->next++];
+
+    resp_init(&p->resp, checkip_keys, checkip_feed, &p->c);
+    p->race = r;
+    p->x.ep = r->af == AF_INET6 ? EP_CHECKIP6 : EP_CHECKIP;
+    p->x.url = p->ep->url;
+    p->x.iface = r->iface;
+    p->x.resp = &p->resp;
+    p->x.start = probe_start;
+    p->x.done = probe_done;
+    p->x.arg = p;
+    ++r->inflight;
+    transport_submit(&p->x);
+}
+
+static void probe_done(xfer_t *x)
+{
+    probe_t *p = x->arg;
+    race_t *r = p->race;
+    size_t i;
+    int votes = 0, best = 0;
+
+    --r->inflight;
+    probe_parse(p);
+    ep_record(p->ep, p->valid, now_ms() - p->t0);
+    if (!p->valid) {
+        if (x->result != CURLE_OK)
+            log_line("checkip: [%s] failed: %s", p->ep->url,
+                     x->err[0] ? x->err : curl_easy_strerror(x->result));
+        else if (p->resp.status >= 400)
+            log_line("checkip: [%s] returned HTTP %ld", p->ep->url,
+                     p->resp.status);
+    }
+    if (r->answer)
+        return;
+
+    /* Tally the answers so far against this one and the leader. */
+    for (i = 0; i < r->next; ++i) {
+        probe_t *q = &r->probes[i];
+        int n = 0;
+        size_t j;
+
+        if (!q->valid)
+            continue;
+        for (j = 0; j < r->next; ++j)
+            if (r->probes[j].valid && !strcmp(r->probes[j].c.ip, q->c.ip))
+                ++n;
+        if (q == p)
+            votes = n;
+        if (n > best)
+            best = n;
+    }
+
+    if (p->valid && votes >= r->quorum) {
+        double now = now_ms();
+
+        r->answer = p->c.ip;
+        /* A probe that lost the race took at least this long. */
+        for (i = 0; i < r->next; ++i) {
+            probe_t *q = &r->probes[i];
+            int flying = q->x.h != NULL;
+
+            if (q == p)
+                continue;
+            transport_cancel(&q->x);
+            if (flying)
+                ep_sample(q->ep, now - q->t0);
+        }
+        r->inflight = 0;
+        return;
+    }
+    /* Bring in another endpoint whenever those still out could no longer
+     * make up the quorum. */
+    while (best + r->inflight < r->quorum && r->next < r->n)
+        race_launch(r);
+}
+
+/* allocates from the cycle arena for return; returns NULL if the
+ * endpoints in set fail to agree on an address of family af.  The queries
+ * are sent from iface unless it is NULL.  Callers must not query more
+ * often than every CHECKIP_INTERVAL seconds. */
+static char *query_remote(checkip_set_t *set, int af, char *iface)
+{
+    checkip_ep_t *e;
+    race_t r;
+    size_t i, j, first;
+    char *ret = NULL;
+
+    memset(&r, 0, sizeof r);
+    for (e = set->eps; e; e = e->next)
+        ++r.n;
+    if (!r.n)
+        return NULL;
+    r.probes = arena_alloc(r.n * sizeof (probe_t));
+    memset(r.probes, 0, r.n * sizeof (probe_t));
+    r.af = af;
+    r.iface = iface;
+    r.quorum = checkip_quorum < (int)r.n ? checkip_quorum : (int)r.n;
+
+    /* Insertion sort by score; the list is short and stays in config
+     * order among equals. */
+    for (e = set->eps, i = 0; e; e = e->next, ++i) {
+        for (j = i; j > 0 && ep_score(r.probes[j - 1].ep) > ep_score(e); --j)
+            r.probes[j].ep = r.probes[j - 1].ep;
+        r.probes[j].ep = e;
+    }
+
+    first = (size_t)r.quorum + CHECKIP_SPARES;
+    while (r.next < first && r.next < r.n)
+        race_launch(&r);
+    transport_run();
+
+    if (r.answer)
+        ret = arena_strdup(r.answer);
+    else
+        log_line("Failed to get IP from remote host.");
     return ret;
 }
 
+/* allocates from the cycle arena for return;
+ * returns NULL if remote host fails to give ip
+ */
+char *query_curip(char *iface)
+{
+    static checkip_ep_t dflt = { .url = CHECKIP_URL };
+
+    if (!checkip4.eps)
+        checkip4.eps = &dflt;
+    return query_remote(&checkip4, AF_INET, iface);
+}
+
+/* As query_curip(), but asks over IPv6 for the IPv6 address.  There is no
+ * default service, so NULL is returned unless checkip6 is configured. */
+char *query_curip6(char *iface)
+{
+    return query_remote(&checkip6, AF_INET6, iface);
+}
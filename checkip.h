@@ -28,6 +28,10 @@
 
 #ifndef NJK_CHECKIP_H_
 #define NJK_CHECKIP_H_ 1
-char *query_curip(void);
+char *query_curip(char *iface);
+char *query_curip6(char *iface);
+void checkip_add_url(char *url);
+void checkip6_add_url(char *url);
+void checkip_set_quorum(int n);
 #endif
 
@@ -0,0 +1,297 @@
+/* control.c - control socket for update triggers and state queries
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "defines.h"
+#include "control.h"
+#include "hostlist.h"
+#include "retry.h"
+#include "state.h"
+#include "urlbuf.h"
+#include "util.h"
+#include "log.h"
+#include "strl.h"
+#include "provider.h"
+
+/*
+ * If [config] has a control = PATH line, ndyndns listens on a Unix stream
+ * socket at PATH, inside the chroot.  A client sends a single request line
+ * and reads the reply until ndyndns closes the connection.  The first line
+ * of a reply is "ok" or "error MESSAGE".
+ *
+ *   update [HOST|PROVIDER]  check the addresses and update the hosts that
+ *                           need it now, rather than at the next cycle;
+ *                           a named host also has its retry backoff reset
+ *   state [HOST]            one line per host after the "ok":
+ *                           PROVIDER HOST IP IP6 DATE NEXT LOCK
+ *   clear HOST              remove the error lock of HOST
+ *
+ * DATE is the time of the last update in seconds since the epoch, NEXT the
+ * seconds until the host is next due for a retry or refresh, and LOCK the
+ * error that locked the host; absent fields are "-".  Requests are served
+ * between update cycles, while the daemon sleeps.
+ */
+
+static char ctl_path[MAX_PATH_LENGTH];
+static int ctl_fd = -1;
+
+void control_set_path(char *path)
+{
+    strnkcpy(ctl_path, path, sizeof ctl_path);
+}
+
+/* Starts listening if a socket is configured.  Returns its descriptor, or
+ * -1 if there is none. */
+int control_open(void)
+{
+    struct sockaddr_un sa;
+
+    if (!ctl_path[0])
+        return -1;
+    memset(&sa, 0, sizeof sa);
+    sa.sun_family = AF_UNIX;
+    if (strnkcpy(sa.sun_path, ctl_path, sizeof sa.sun_path)) {
+        log_line("Control socket path [%s] is too long.", ctl_path);
+        return -1;
+    }
+
+    ctl_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (ctl_fd == -1) {
+        log_line("%s: socket failed: %s", __func__, strerror(errno));
+        return -1;
+    }
+    unlink(ctl_path);
+    if (bind(ctl_fd, (struct sockaddr *)&sa, sizeof sa) ||
+        listen(ctl_fd, 8)) {
+        log_line("Could not listen on control socket [%s]: %s", ctl_path,
+                 strerror(errno));
+        close(ctl_fd);
+        ctl_fd = -1;
+        return -1;
+    }
+    fcntl(ctl_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(ctl_fd, F_SETFL, fcntl(ctl_fd, F_GETFL) | O_NONBLOCK);
+    log_line("Listening for control requests on [%s].", ctl_path);
+    return ctl_fd;
+}
+
+static void put_num(urlbuf_t *out, long n)
+{
+    char buf[24];
+
+    snprintf(buf, sizeof buf, " %ld", n);
+    ub_puts(out, buf);
+}
+
+static void put_field(urlbuf_t *out, char *s)
+{
+    ub_puts(out, " ");
+    ub_puts(out, s ? s : "-");
+}
+
+/* Reports one host; hd is NULL for a host that is only known to the state
+ * records. */
+static void put_host(urlbuf_t *out, const char *label, char *host,
+                     hostdata_t *hd, time_t now)
+{
+    state_rec_t *r = state_lookup(host);
+
+    ub_puts(out, label);
+    put_field(out, host);
+    put_field(out, hd ? hd->ip : r ? r->ip : NULL);
+    put_field(out, hd ? hd->ip6 : r ? r->ip6 : NULL);
+    if (hd || r)
+        put_num(out, (long)(hd ? hd->date : r->date));
+    else
+        put_field(out, NULL);
+    if (hd && hd->sched.slot)
+        put_num(out, (long)(hd->sched.due > now ? hd->sched.due - now : 0));
+    else
+        put_field(out, NULL);
+    put_field(out, r ? r->err : NULL);
+    ub_puts(out, "\n");
+}
+
+static int req_update(urlbuf_t *out, char *arg)
+{
+    hostgroup_t *g;
+    hostdata_t *hd;
+    int i, found = 0;
+
+    for (i = 0; i < PROV_MAX; ++i) {
+        if (!arg || !strcmp(arg, providers[i]->name)) {
+            for (g = providers[i]->list->groups; g; g = g->next)
+                g->scanned = 0;
+            found = 1;
+        } else if ((hd = hostlist_find(providers[i]->list, arg))) {
+            retry_clear(hd);
+            hostlist_rescan(hd);
+            found = 1;
+        }
+    }
+    if (!found) {
+        ub_puts(out, "error no such host or provider\n");
+        return 0;
+    }
+    log_line("Update requested for [%s].", arg ? arg : "all hosts");
+    ub_puts(out, "ok\n");
+    return CONTROL_CYCLE;
+}
+
+static int req_state(urlbuf_t *out, char *arg)
+{
+    time_t now = clock_mono();
+    hostdata_t *hd;
+    int i, found = 0;
+
+    ub_puts(out, "ok\n");
+    for (i = 0; i < PROV_MAX; ++i) {
+        if (arg) {
+            hd = hostlist_find(providers[i]->list, arg);
+            if (hd) {
+                put_host(out, providers[i]->label, hd->host, hd, now);
+                found = 1;
+            }
+            continue;
+        }
+        for (hd = providers[i]->list->head; hd; hd = hd->next)
+            put_host(out, providers[i]->label, hd->host, hd, now);
+    }
+    if (arg && !found) {
+        /* a locked host is no longer in any list */
+        if (!state_lookup(arg)) {
+            ub_trunc(out, 0);
+            ub_puts(out, "error no such host\n");
+            return 0;
+        }
+        put_host(out, "-", arg, NULL, now);
+    }
+    return 0;
+}
+
+static int req_clear(urlbuf_t *out, char *arg)
+{
+    if (!arg) {
+        ub_puts(out, "error no host given\n");
+        return 0;
+    }
+    if (state_clear_err(arg)) {
+        ub_puts(out, "error host is not locked\n");
+        return 0;
+    }
+    log_line("Lock on [%s] cleared by a control request.", arg);
+    state_commit();
+    ub_puts(out, "ok\n");
+    /* The host is added back to its list by a reload. */
+    return CONTROL_RELOAD | CONTROL_CYCLE;
+}
+
+/* Reads a request line into buf.  Returns -1 if none arrived. */
+static int read_request(int fd, char *buf, size_t size)
+{
+    size_t n = 0;
+    ssize_t r;
+
+    while (n < size - 1) {
+        r = read(fd, buf + n, size - 1 - n);
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            break;
+        n += r;
+        if (memchr(buf, '\n', n))
+            break;
+    }
+    buf[n] = '\0';
+    return n ? 0 : -1;
+}
+
+static int serve_one(int fd)
+{
+    struct timeval tv = { CONTROL_TIMEOUT, 0 };
+    char req[CONTROL_MAX_REQ], *cmd, *arg, *save, *p;
+    urlbuf_t out = { NULL, 0, 0 };
+    ssize_t r;
+    int ret = 0;
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+    if (read_request(fd, req, sizeof req))
+        return 0;
+
+    cmd = strtok_r(req, " \t\r\n", &save);
+    arg = cmd ? strtok_r(NULL, " \t\r\n", &save) : NULL;
+    if (!cmd)
+        ub_puts(&out, "error empty request\n");
+    else if (!strcmp(cmd, "update"))
+        ret = req_update(&out, arg);
+    else if (!strcmp(cmd, "state"))
+        ret = req_state(&out, arg);
+    else if (!strcmp(cmd, "clear"))
+        ret = req_clear(&out, arg);
+    else
+        ub_puts(&out, "error unknown request\n");
+
+    for (p = out.buf; p < out.buf + out.len; p += r) {
+        r = write(fd, p, out.buf + out.len - p);
+        if (r == -1) {
+            if (errno == EINTR) {
+                r = 0;
+                continue;
+            }
+            break;
+        }
+    }
+    ub_free(&out);
+    return ret;
+}
+
+/* Serves every waiting request.  Returns the CONTROL_* actions that they
+ * asked for. */
+int control_serve(void)
+{
+    int fd, ret = 0;
+
+    if (ctl_fd == -1)
+        return 0;
+    while ((fd = accept(ctl_fd, NULL, NULL)) != -1) {
+        ret |= serve_one(fd);
+        close(fd);
+    }
+    return ret;
+}
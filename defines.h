@@ -30,7 +30,51 @@
 
 #define MAX_PATH_LENGTH 1024
 #define MAX_BUF 1024
-#define MAX_CHUNKS 3
+
+#define RESP_MAX_BODY 49152 /* response bytes read before closing transfer */
+
+#define MAX_XFERS 16            /* concurrent update requests */
+#define MAX_XFERS_PER_EP 4      /* ... to any one provider endpoint */
+#define MAX_STREAMS_PER_EP 64   /* ... to one that multiplexes over HTTP/2 */
+#define XFER_CONNECT_TIMEOUT 30 /* seconds */
+#define XFER_TIMEOUT 90         /* seconds */
+
+#define ARENA_CHUNK 16384       /* bytes per per-cycle arena chunk */
+
+#define STATE_COMPACT_SLACK 64  /* superseded journal lines before compacting */
+
+#define RETRY_BASE 5            /* seconds before the first retry */
+#define RETRY_CAP 1800          /* longest retry backoff, seconds */
+
+#define CHECKIP_INTERVAL 600    /* least seconds between remote queries */
+#define CHECKIP_RETRY 60        /* seconds after a failed remote query */
+#define CHECKIP_SPARES 2        /* endpoints raced beyond the quorum */
+
+#define STUN_PORT "3478"
+#define STUN_RTO 500            /* ms before the first retransmission */
+#define STUN_TRIES 3            /* transmissions, each waiting twice as long */
+#define STUN_POLL_INTERVAL 15   /* seconds between checks of STUN sources */
+
+#define DNSCHECK_INTERVAL 3600  /* seconds between checks of records */
+#define DNSCHECK_GRACE 900      /* seconds after an update before checking it */
+#define DNSCHECK_ZONE_TTL 86400 /* seconds before re-finding zone servers */
+#define DNSCHECK_ZONE_RETRY 600 /* seconds before a failed zone is retried */
+#define DNSCHECK_ZONE_BUDGET 5  /* seconds per check spent finding zones */
+#define DNSCHECK_DEADLINE 15    /* seconds that a whole check may take */
+#define DNSCHECK_RTO 500        /* ms before the first retransmission */
+#define DNSCHECK_TRIES 3        /* transmissions, each waiting twice as long */
+#define DNSCHECK_MAX_INFLIGHT 64 /* queries outstanding at once */
+#define DNSCHECK_MAX_SERVERS 4  /* servers used per zone */
+#define DNSCHECK_MAX_ADDRS 8    /* addresses read per answer */
+
+#define DYNDNS_MAX_BATCH 20     /* hosts per dyndns2 update request */
+#define DYNDNS_MAX_URL 1024     /* bytes per dyndns2 update URL */
+
+#define RESOLVE_MAX_INFLIGHT 32 /* concurrent startup DNS lookups */
+#define RESOLVE_TIMEOUT 10      /* seconds per lookup */
+
+#define CONTROL_TIMEOUT 2       /* seconds a control client may stall */
+#define CONTROL_MAX_REQ 512     /* longest control request line */
 
 #endif
 
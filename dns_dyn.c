@@ -26,6 +26,7 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
@@ -35,207 +36,221 @@
 #include "defines.h"
 #include "dns_dyn.h"
 #include "dns_helpers.h"
+#include "retry.h"
+#include "source.h"
 #include "log.h"
 #include "util.h"
-#include "strl.h"
-#include "strlist.h"
+#include "urlbuf.h"
+#include "arena.h"
 #include "malloc.h"
 
+#define DYN_REFRESH_INTERVAL (28*24*3600 + 60)
+
 dyndns_conf_t dyndns_conf;
 
-void init_dyndns_conf()
+static void dd_init(void *conf)
 {
-    dyndns_conf.username = NULL;
-    dyndns_conf.password = NULL;
-    dyndns_conf.hostlist = NULL;
-    dyndns_conf.mx = NULL;
-    dyndns_conf.wildcard = WC_NOCHANGE;
-    dyndns_conf.backmx = BMX_NOCHANGE;
-    dyndns_conf.offline = OFFLINE_NO;
-    dyndns_conf.system = SYSTEM_DYNDNS;
+    dyndns_conf_t *t = conf;
+
+    t->username = NULL;
+    t->password = NULL;
+    memset(&t->hostlist, 0, sizeof t->hostlist);
+    t->mx = NULL;
+    t->wildcard = WC_NOCHANGE;
+    t->backmx = BMX_NOCHANGE;
+    t->offline = OFFLINE_NO;
+    t->system = SYSTEM_DYNDNS;
+    t->server = NULL;
 }
 
-static void modify_dyn_hostip_in_list(dyndns_conf_t *conf, char *host, char *ip)
+/* returns 1 for valid config, 0 for invalid; hosts is nonzero if any
+ * hosts are listed */
+static int dd_validate(void *conf, int hosts)
 {
-    hostdata_t *t;
-    size_t len;
-    char *buf;
-
-    if (!conf || !host || !conf->hostlist)
-        return;
-
-    for (t = conf->hostlist; t && strcmp(t->host, host); t = t->next);
+    dyndns_conf_t *t = conf;
+    int r = 1;
 
-    if (!t)
-        return; /* not found */
-
-    free(t->ip);
-    if (!ip) {
-        t->ip = ip;
-        return;
+    if (t->username || t->password || hosts) {
+        if (t->username == NULL) {
+            r = 0;
+            log_line("dyndns config invalid: no username provided");
+        }
+        if (t->password == NULL) {
+            r = 0;
+            log_line("dyndns config invalid: no password provided");
+        }
+        if (!hosts) {
+            r = 0;
+            log_line("dyndns config invalid: no hostnames provided");
+        }
     }
-    len = strlen(ip) + 1;
-    buf = xmalloc(len);
-    strnkcpy(buf, ip, len);
-    t->ip = buf;
+    return r;
 }
 
-static void modify_dyn_hostdate_in_list(dyndns_conf_t *conf, char *host,
-                                        time_t time)
+#define DD_STRING(key, field) \
+    { key, PK_STRING, offsetof(dyndns_conf_t, field), 0 }
+#define DD_FLAG(key, field, value) \
+    { key, PK_FLAG, offsetof(dyndns_conf_t, field), value }
+
+static const provider_key_t dd_cfg_keys[] = {
+    DD_STRING(K_PASSWORD, password),
+    { K_HOSTS, PK_HOSTS, 0, 0 },
+    DD_STRING(K_USERNAME, username),
+    DD_STRING(K_SERVER, server),
+    DD_STRING(K_MX, mx),
+    DD_FLAG(K_NOWILDCARD, wildcard, WC_NO),
+    DD_FLAG(K_WILDCARD, wildcard, WC_YES),
+    DD_FLAG(K_PRIMARYMX, backmx, BMX_NO),
+    DD_FLAG(K_BACKUPMX, backmx, BMX_YES),
+    DD_FLAG(K_OFFLINE, offline, OFFLINE_YES),
+    DD_FLAG(K_DYNDNS, system, SYSTEM_DYNDNS),
+    DD_FLAG(K_CUSTOMDNS, system, SYSTEM_CUSTOMDNS),
+    DD_FLAG(K_STATICDNS, system, SYSTEM_STATDNS),
+    PK_END
+};
+#undef DD_STRING
+#undef DD_FLAG
+
+static hostdata_t **dd_update_list = NULL;
+static size_t dd_update_count, dd_update_size;
+
+static void dd_queue(hostdata_t *hd)
 {
-    hostdata_t *t;
-
-    if (!conf || !host || !conf->hostlist)
-        return;
-
-    for (t = conf->hostlist; t && strcmp(t->host, host); t = t->next);
-
-    if (!t)
-        return; /* not found */
-
-    t->date = time;
+    if (dd_update_count == dd_update_size) {
+        hostdata_t **n;
+        dd_update_size = dd_update_size ? dd_update_size * 2 : 16;
+        n = xmalloc(dd_update_size * sizeof (hostdata_t *));
+        if (dd_update_count)
+            memcpy(n, dd_update_list, dd_update_count * sizeof (hostdata_t *));
+        free(dd_update_list);
+        dd_update_list = n;
+    }
+    dd_update_list[dd_update_count++] = hd;
 }
 
+/* one batch of hosts sent in a single request; codes[] parallels hosts[] */
 typedef struct {
-    return_codes code;
-    void *next;
-} return_code_list_t;
-
-static return_code_list_t *dd_return_list = NULL;
-static strlist_t *dd_update_list = NULL;
-
-static void add_to_return_code_list(return_codes name,
-                                    return_code_list_t **list)
-{
-    return_code_list_t *item, *t;
-
-    if (!list)
-        return;
-
-    item = xmalloc(sizeof (return_code_list_t));
-    item->code = name;
-    item->next = NULL;
-
-    if (!*list) {
-        *list = item;
-        return;
-    }
-    t = *list;
-    while (t) {
-        if (t->next == NULL) {
-            t->next = item;
-            return;
-        }
-        t = t->next;
-    }
-
-    log_line("%s: failed to add item", __func__);
-    free(item);
-}
+    char *ip4;                  /* addresses sent; either may be NULL */
+    char *ip6;
+    hostdata_t **hosts;
+    return_codes *codes;
+    size_t ncodes, nhosts;
+    char tok[16];               /* longer than any status keyword */
+    size_t toklen;              /* may exceed sizeof tok */
+} dd_req_t;
+
+/*
+ * The status keywords are told apart by a perfect hash of their length and
+ * first and last characters, so a token costs one table probe and one
+ * compare.  A token must match a keyword exactly; the address after good
+ * and nochg, and anything else, classifies as RET_DO_NOTHING.  Adding a
+ * keyword that collides makes two initializers share a slot, which
+ * -Woverride-init reports; pick another multiplier if that happens.  The
+ * first and last characters are repeated in the table because a string
+ * literal's characters are not constant expressions.
+ */
+#define DD_HASH(len, first, last) (((len) + (first) + 21 * (last)) & 31)
+#define DD_CODE(tok, first, last, code) \
+    [DD_HASH(sizeof tok - 1, first, last)] = { tok, sizeof tok - 1, code }
 
-static void free_return_code_list(return_code_list_t *head)
+static const struct {
+    const char *tok;
+    size_t len;
+    return_codes code;
+} dd_codes[32] = {
+    DD_CODE("badsys", 'b', 's', RET_BADSYS),
+    DD_CODE("badagent", 'b', 't', RET_BADAGENT),
+    DD_CODE("badauth", 'b', 'h', RET_BADAUTH),
+    DD_CODE("!donator", '!', 'r', RET_NOTDONATOR),
+    DD_CODE("good", 'g', 'd', RET_GOOD),
+    DD_CODE("nochg", 'n', 'g', RET_NOCHG),
+    DD_CODE("notfqdn", 'n', 'n', RET_NOTFQDN),
+    DD_CODE("nohost", 'n', 't', RET_NOHOST),
+    DD_CODE("!yours", '!', 's', RET_NOTYOURS),
+    DD_CODE("abuse", 'a', 'e', RET_ABUSE),
+    DD_CODE("numhost", 'n', 't', RET_NUMHOST),
+    DD_CODE("dnserr", 'd', 'r', RET_DNSERR),
+    DD_CODE("911", '9', '1', RET_911),
+};
+
+return_codes dyndns_classify(const char *tok, size_t len)
 {
-    return_code_list_t *p = head, *q = NULL;
-
-    while (p != NULL) {
-        q = p;
-        p = q->next;
-        free(q);
-    }
+    unsigned int h;
+
+    if (!len)
+        return RET_DO_NOTHING;
+    h = DD_HASH(len, (unsigned char)tok[0], (unsigned char)tok[len - 1]);
+    if (dd_codes[h].len != len || memcmp(dd_codes[h].tok, tok, len))
+        return RET_DO_NOTHING;
+    return dd_codes[h].code;
 }
 
-int get_return_code_list_arity(return_code_list_t *list)
+static void dd_end_token(dd_req_t *d)
 {
-    int i;
-    return_code_list_t *c;
+    return_codes code = RET_DO_NOTHING;
 
-    for (c = list, i = 0; c != NULL; c = c->next, ++i);
-    return i;
+    if (!d->toklen)
+        return;
+    if (d->toklen <= sizeof d->tok)
+        code = dyndns_classify(d->tok, d->toklen);
+    d->toklen = 0;
+    if (code != RET_DO_NOTHING && d->ncodes < d->nhosts)
+        d->codes[d->ncodes++] = code;
 }
 
 /* not really well documented, so here:
- * return from the server will be stored in a buffer
- * buffer will look like:
+ * the server returns one whitespace-separated status per host:
  good 1.12.123.9
  nochg 1.12.123.9
  nochg 1.12.123.9
  nochg 1.12.123.9
+ * Tokens may be split across chunks; over-long ones match nothing.  The
+ * response is decided once every host in the batch has a status.
 */
-static void decompose_buf_to_list(char *buf)
+static int dd_feed(resp_t *r, const char *buf, size_t len)
 {
-    char tok[MAX_BUF], *point = buf;
+    dd_req_t *d = r->arg;
     size_t i;
 
-    free_return_code_list(dd_return_list);
-    dd_return_list = NULL;
-
-    while (*point != '\0') {
-        while (*point != '\0' && isspace(*point))
-            point++;
-        memset(tok, '\0', sizeof tok);
-
-        /* fetch one token */
-        i = 0;
-        while (i < sizeof tok && *point != '\0' && !isspace(*point))
-            tok[i++] = *(point++);
-
-        if (strstr(tok, "badsys")) {
-            add_to_return_code_list(RET_BADSYS, &dd_return_list);
-            continue;
-        }
-        if (strstr(tok, "badagent")) {
-            add_to_return_code_list(RET_BADAGENT, &dd_return_list);
-            continue;
-        }
-        if (strstr(tok, "badauth")) {
-            add_to_return_code_list(RET_BADAUTH, &dd_return_list);
-            continue;
-        }
-        if (strstr(tok, "!donator")) {
-            add_to_return_code_list(RET_NOTDONATOR, &dd_return_list);
-            continue;
-        }
-        if (strstr(tok, "good")) {
-            add_to_return_code_list(RET_GOOD, &dd_return_list);
-            continue;
-        }
-        if (strstr(tok, "nochg")) {
-            add_to_return_code_list(RET_NOCHG, &dd_return_list);
-            continue;
-        }
-        if (strstr(tok, "notfqdn")) {
-            add_to_return_code_list(RET_NOTFQDN, &dd_return_list);
-            continue;
-        }
-        if (strstr(tok, "nohost")) {
-            add_to_return_code_list(RET_NOHOST, &dd_return_list);
-            continue;
-        }
-        if (strstr(tok, "!yours")) {
-            add_to_return_code_list(RET_NOTYOURS, &dd_return_list);
-            continue;
-        }
-        if (strstr(tok, "abuse")) {
-            add_to_return_code_list(RET_ABUSE, &dd_return_list);
-            continue;
-        }
-        if (strstr(tok, "numhost")) {
-            add_to_return_code_list(RET_NUMHOST, &dd_return_list);
-            continue;
-        }
-        if (strstr(tok, "dnserr")) {
-            add_to_return_code_list(RET_DNSERR, &dd_return_list);
-            continue;
-        }
-        if (strstr(tok, "911")) {
-            add_to_return_code_list(RET_911, &dd_return_list);
+    for (i = 0; i < len && d->ncodes < d->nhosts; ++i) {
+        if (isspace((unsigned char)buf[i])) {
+            dd_end_token(d);
             continue;
         }
+        if (d->toklen < sizeof d->tok)
+            d->tok[d->toklen] = buf[i];
+        ++d->toklen;
+    }
+    if (!len)
+        dd_end_token(d);
+    return d->ncodes == d->nhosts || !len ? RESP_DONE : RESP_MORE;
+}
+
+/* Runs the reply parser over buf as if it arrived in chunks of at most
+ * chunk bytes, storing up to n statuses in codes.  Returns the number
+ * stored.  For exercising the parser outside a transfer. */
+size_t dyndns_parse_reply(const char *buf, size_t len, size_t chunk,
+                          return_codes *codes, size_t n)
+{
+    dd_req_t d;
+    resp_t r;
+    size_t off, step;
+
+    memset(&d, 0, sizeof d);
+    d.codes = codes;
+    d.nhosts = n;
+    resp_init(&r, NULL, dd_feed, &d);
+    for (off = 0; off < len; off += step) {
+        step = len - off < chunk ? len - off : chunk;
+        if (dd_feed(&r, buf + off, step) == RESP_DONE)
+            return d.ncodes;
     }
+    dd_feed(&r, buf, 0);
+    return d.ncodes;
 }
 
 /* -1 indicates hard error, -2 soft error on hostname, 0 success */
-static int postprocess_update(char *host, char *curip, return_codes retcode)
+static int postprocess_update(char *host, return_codes retcode)
 {
     int ret = -2;
 
@@ -280,155 +295,250 @@ static int postprocess_update(char *host, char *curip, return_codes retcode)
             /* Don't hardfail, 'success' */
         case RET_GOOD:
             log_line("%s: [good] - Update successful.", host);
-            write_dnsip(host, curip);
-            write_dnsdate(host, clock_time());
             ret = 0;
             break;
         case RET_NOCHG:
             log_line("%s: [nochg] - Unnecessary update; further updates will be considered abusive.", host);
-            write_dnsip(host, curip);
-            write_dnsdate(host, clock_time());
             ret = 0;
             break;
     }
     return ret;
 }
 
-static void dyndns_update_ip(char *curip)
+static void dyndns_update_done(int ret, resp_t *resp, void *arg)
 {
-    int runonce = 0;
-    char url[MAX_BUF];
-    char unpwd[256];
-    strlist_t *t;
-    return_code_list_t *u;
-    int ret;
-    conn_data_t data;
-
-    if (!dd_update_list || !curip)
-        return;
+    dd_req_t *d = arg;
+    hostdata_t *hd;
+    size_t i;
 
-    /* set up the authentication url */
-    if (use_ssl)
-        DDCB_CPY(url, "https");
-    else
-        DDCB_CPY(url, "http");
-    DDCB_CAT(url, "://members.dyndns.org/nic/update?");
+    if (ret > 0) {
+        if (ret == 2) { /* Permanent error. */
+            log_line("[%s] had a non-recoverable HTTP error.  Removing from updates.  Restart the daemon to re-enable updates.", d->hosts[0]->host);
+            for (i = 0; i < d->nhosts; ++i)
+                hostlist_remove(&dyndns_conf.hostlist, d->hosts[i]);
+        } else {
+            for (i = 0; i < d->nhosts; ++i)
+                retry_defer(d->hosts[i], resp->retry_after);
+        }
+        return;
+    }
 
-    DDCB_CAT(url, "system=");
-    switch (dyndns_conf.system) {
-    case SYSTEM_STATDNS: DDCB_CAT(url, "statdns"); break;
-    case SYSTEM_CUSTOMDNS: DDCB_CAT(url, "custom"); break;
-    default: DDCB_CAT(url, "dyndns"); break;
+    if (d->ncodes != d->nhosts) {
+        log_line("list arity doesn't match, updates may be suspect");
+        hostlist_rescan(d->hosts[0]);
     }
 
-    DDCB_CAT(url, "&hostname=");
-    for (t = dd_update_list, runonce = 0; t != NULL; t = t->next) {
-        if (runonce)
-            DDCB_CAT(url, ",");
-        runonce = 1;
-        DDCB_CAT(url, t->str);
+    for (i = 0; i < d->ncodes; ++i) {
+        hd = d->hosts[i];
+        ret = postprocess_update(hd->host, d->codes[i]);
+        switch (ret) {
+            case -1:
+            default:
+                exit(EXIT_FAILURE);
+                break;
+            case -2:
+                log_line("[%s] has a configuration problem.  Refusing to update until %s-dnserr is removed.", hd->host, hd->host);
+                write_dnserr(hd->host, ret);
+                hostlist_remove(&dyndns_conf.hostlist, hd);
+                break;
+            case 0:
+                if (d->ip4) {
+                    write_dnsip(hd->host, d->ip4);
+                    hostdata_set_ip(hd, d->ip4);
+                }
+                if (d->ip6) {
+                    write_dnsip(hd->host, d->ip6);
+                    hostdata_set_ip(hd, d->ip6);
+                }
+                write_dnsdate(hd->host, clock_time());
+                hd->date = clock_time();
+                retry_clear(hd);
+                if (dyndns_conf.system == SYSTEM_DYNDNS)
+                    hostlist_schedule(hd, clock_mono() +
+                                      DYN_REFRESH_INTERVAL + 1);
+                break;
+        }
     }
+}
+
+static void dyndns_queue_batch(char *url, char *unpwd, curaddr_t *cur,
+                               size_t start, size_t end)
+{
+    dd_req_t *d = arena_alloc(sizeof (dd_req_t));
+
+    memset(d, 0, sizeof *d);
+    d->ip4 = cur->v4 ? arena_strdup(cur->v4) : NULL;
+    d->ip6 = cur->v6 ? arena_strdup(cur->v6) : NULL;
+    d->nhosts = end - start;
+    d->hosts = arena_alloc(d->nhosts * sizeof (hostdata_t *));
+    memcpy(d->hosts, dd_update_list + start,
+           d->nhosts * sizeof (hostdata_t *));
+    d->codes = arena_alloc(d->nhosts * sizeof (return_codes));
+    dyndns_curl_queue(EP_DYNDNS, url, unpwd, NULL, dd_feed,
+                      dyndns_update_done, d);
+}
+
+/* The parts of an update request that depend only on the configuration
+ * are built once, by dd_compile(): the URL up to the host list, the
+ * arguments after the address and the credentials.  dd_url keeps the head
+ * between requests and is cut back to it for each one. */
+static urlbuf_t dd_url, dd_tail, dd_unpwd;
+static size_t dd_head_len;
 
-    DDCB_CAT(url, "&myip=");
-    DDCB_CAT(url, curip);
+static void dd_compile(void)
+{
+    ub_trunc(&dd_url, 0);
+    ub_trunc(&dd_tail, 0);
+    ub_trunc(&dd_unpwd, 0);
+    dd_head_len = 0;
+    if (!dyndns_conf.username || !dyndns_conf.password)
+        return;
 
-    DDCB_CAT(url, "&wildcard=");
+    ub_base(&dd_url, dyndns_conf.server, "members.dyndns.org", use_ssl);
+    ub_puts(&dd_url, "/nic/update?system=");
+    switch (dyndns_conf.system) {
+    case SYSTEM_STATDNS: ub_puts(&dd_url, "statdns"); break;
+    case SYSTEM_CUSTOMDNS: ub_puts(&dd_url, "custom"); break;
+    default: ub_puts(&dd_url, "dyndns"); break;
+    }
+    ub_puts(&dd_url, "&hostname=");
+    dd_head_len = dd_url.len;
+
+    ub_puts(&dd_tail, "&wildcard=");
     switch (dyndns_conf.wildcard) {
-    case WC_YES: DDCB_CAT(url, "ON"); break;
-    case WC_NO: DDCB_CAT(url, "OFF"); break;
-    default: DDCB_CAT(url, "NOCHG"); break;
+    case WC_YES: ub_puts(&dd_tail, "ON"); break;
+    case WC_NO: ub_puts(&dd_tail, "OFF"); break;
+    default: ub_puts(&dd_tail, "NOCHG"); break;
     }
 
-    DDCB_CAT(url, "&mx=");
+    ub_puts(&dd_tail, "&mx=");
     if (!dyndns_conf.mx)
-        DDCB_CAT(url, "NOCHG");
+        ub_puts(&dd_tail, "NOCHG");
     else
-        DDCB_CAT(url, dyndns_conf.mx);
+        ub_enc(&dd_tail, dyndns_conf.mx);
 
-    DDCB_CAT(url, "&backmx=");
+    ub_puts(&dd_tail, "&backmx=");
     switch (dyndns_conf.backmx) {
-    case BMX_YES: DDCB_CAT(url, "YES"); break;
-    case BMX_NO: DDCB_CAT(url, "NO"); break;
-    default: DDCB_CAT(url, "NOCHG"); break;
+    case BMX_YES: ub_puts(&dd_tail, "YES"); break;
+    case BMX_NO: ub_puts(&dd_tail, "NO"); break;
+    default: ub_puts(&dd_tail, "NOCHG"); break;
     }
 
-    DDCB_CAT(url, "&offline=");
+    ub_puts(&dd_tail, "&offline=");
     switch (dyndns_conf.offline) {
-    case OFFLINE_YES: DDCB_CAT(url, "YES"); break;
-    default: DDCB_CAT(url, "NO"); break;
+    case OFFLINE_YES: ub_puts(&dd_tail, "YES"); break;
+    default: ub_puts(&dd_tail, "NO"); break;
     }
 
-    /* set up username:password pair */
-    DDCB_CPY(unpwd, dyndns_conf.username);
-    DDCB_CAT(unpwd, ":");
-    DDCB_CAT(unpwd, dyndns_conf.password);
+    /* libcurl takes the pair as is */
+    ub_puts(&dd_unpwd, dyndns_conf.username);
+    ub_puts(&dd_unpwd, ":");
+    ub_puts(&dd_unpwd, dyndns_conf.password);
+}
 
-    data.buf = xmalloc(MAX_CHUNKS * CURL_MAX_WRITE_SIZE + 1);
-    memset(data.buf, '\0', MAX_CHUNKS * CURL_MAX_WRITE_SIZE + 1);
-    data.buflen = MAX_CHUNKS * CURL_MAX_WRITE_SIZE + 1;
-    data.idx = 0;
+/* The update list is split into batches of at most DYNDNS_MAX_BATCH hosts
+ * whose URL fits in DYNDNS_MAX_URL bytes; a host too long to share a URL
+ * goes alone.  The batches are queued together, so the transport sends
+ * them in parallel over its pooled connections.  Both addresses go in the
+ * one myip= parameter, so a dual-stack change costs a single request. */
+static void dyndns_update_ip(curaddr_t *cur, size_t first, size_t last)
+{
+    size_t i, start, mark, tail;
 
-    ret = dyndns_curl_send(url, &data, unpwd);
-    if (ret > 0) {
-        if (ret == 2) { /* Permanent error. */
-            log_line("[%s] had a non-recoverable HTTP error.  Removing from updates.  Restart the daemon to re-enable updates.", t->str);
-            for (t = dd_update_list, runonce = 0; t != NULL; t = t->next)
-                remove_host_from_hostdata_list(&dyndns_conf.hostlist, t->str);
+    if (first == last || (!cur->v4 && !cur->v6) || !dd_head_len)
+        return;
+
+    /* what follows the host list */
+    tail = sizeof "&myip=" - 1 + dd_tail.len;
+    if (cur->v4)
+        tail += strlen(cur->v4);
+    if (cur->v4 && cur->v6)
+        ++tail;
+    if (cur->v6)
+        tail += strlen(cur->v6);
+
+    for (start = first; start < last; start = i) {
+        ub_trunc(&dd_url, dd_head_len);
+        for (i = start; i < last && i - start < DYNDNS_MAX_BATCH; ++i) {
+            mark = dd_url.len;
+            if (i > start)
+                ub_puts(&dd_url, ",");
+            ub_enc(&dd_url, dd_update_list[i]->host);
+            if (i > start && dd_url.len + tail > DYNDNS_MAX_URL) {
+                ub_trunc(&dd_url, mark);
+                break;
+            }
         }
-        goto out;
+        ub_puts(&dd_url, "&myip=");
+        if (cur->v4)
+            ub_puts(&dd_url, cur->v4);
+        if (cur->v4 && cur->v6)
+            ub_puts(&dd_url, ",");
+        if (cur->v6)
+            ub_puts(&dd_url, cur->v6);
+        ub_cat(&dd_url, &dd_tail);
+        dyndns_queue_batch(dd_url.buf, dd_unpwd.buf, cur, start, i);
     }
+}
 
-    decompose_buf_to_list(data.buf);
-    if (get_strlist_arity(dd_update_list) !=
-        get_return_code_list_arity(dd_return_list)) {
-        log_line("list arity doesn't match, updates may be suspect");
-    }
+/* Hosts with an unchanged address are resent once their refresh deadline
+ * passes.  The deadline is kept on the monotonic clock in the list's
+ * scheduler and checked against the recorded update date when it fires. */
+static int dd_plan(hostdata_t *t, time_t now, time_t wall)
+{
+    int stale = hostdata_stale(t, &t->src->cur);
+    time_t left;
+
+    if (stale || dyndns_conf.system != SYSTEM_DYNDNS)
+        return stale;
+    left = t->date + DYN_REFRESH_INTERVAL - wall;
+    if (left < 0)
+        return PLAN_REFRESH;
+    if (t->retries)
+        retry_clear(t);
+    hostlist_schedule(t, now + left + 1);
+    return 0;
+}
 
-    for (t = dd_update_list, u = dd_return_list;
-         t != NULL && u != NULL; t = t->next, u = u->next) {
+static int by_source(const void *a, const void *b)
+{
+    source_t *x = (*(hostdata_t * const *)a)->src;
+    source_t *y = (*(hostdata_t * const *)b)->src;
 
-        ret = postprocess_update(t->str, curip, u->code);
-        switch (ret) {
-            case -1:
-            default:
-                exit(EXIT_FAILURE);
-                break;
-            case -2:
-                log_line("[%s] has a configuration problem.  Refusing to update until %s-dnserr is removed.", t->str, t->str);
-                write_dnserr(t->str, ret);
-                remove_host_from_hostdata_list(&dyndns_conf.hostlist, t->str);
-                break;
-            case 0:
-                modify_dyn_hostdate_in_list(&dyndns_conf, t->str, clock_time());
-                modify_dyn_hostip_in_list(&dyndns_conf, t->str, curip);
-                break;
-        }
-    }
-  out:
-    free(data.buf);
+    return x < y ? -1 : x > y;
 }
 
-#define DYN_REFRESH_INTERVAL (28*24*3600 + 60)
-void dd_work(char *curip)
+static void dd_flush(void)
 {
-    free_strlist(dd_update_list);
-    free_return_code_list(dd_return_list);
-    dd_update_list = NULL;
-    dd_return_list = NULL;
-
-    for (hostdata_t *t = dyndns_conf.hostlist; t != NULL; t = t->next) {
-        if (strcmp(curip, t->ip)) {
-            log_line("adding for update [%s]", t->host);
-            add_to_strlist(&dd_update_list, t->host);
-            continue;
-        }
-        if (dyndns_conf.system == SYSTEM_DYNDNS &&
-            clock_time() - t->date > DYN_REFRESH_INTERVAL) {
-            log_line("adding for refresh [%s]", t->host);
-            add_to_strlist(&dd_update_list, t->host);
-        }
+    size_t i, j;
+
+    /* Hosts on different sources cannot share a request. */
+    if (dd_update_count > 1)
+        qsort(dd_update_list, dd_update_count, sizeof (hostdata_t *),
+              by_source);
+    for (i = 0; i < dd_update_count; i = j) {
+        for (j = i + 1; j < dd_update_count &&
+             dd_update_list[j]->src == dd_update_list[i]->src; ++j);
+        dyndns_update_ip(&dd_update_list[i]->src->cur, i, j);
     }
-    if (dd_update_list)
-        dyndns_update_ip(curip);
+    dd_update_count = 0;
 }
 
+provider_t dd_provider = {
+    .name = "dyndns",
+    .label = "dyndns",
+    .section = K_DYNDNS_SECTION,
+    .ep = EP_DYNDNS,
+    .list = &dyndns_conf.hostlist,
+    .families = ADDR_V4 | ADDR_V6,
+    .verify = 1,
+    .conf = &dyndns_conf,
+    .conf_size = sizeof (dyndns_conf_t),
+    .keys = dd_cfg_keys,
+    .init = dd_init,
+    .validate = dd_validate,
+    .compile = dd_compile,
+    .plan = dd_plan,
+    .queue = dd_queue,
+    .flush = dd_flush,
+};
@@ -28,7 +28,8 @@
 #ifndef NDYNDNS_DNS_DYN_H_
 #define NDYNDNS_DNS_DYN_H_
 
-#include "cfg.h"
+#include "provider.h"
+#include "dns_helpers.h"
 
 typedef enum {
     WC_NOCHANGE,
@@ -56,17 +57,20 @@ typedef enum {
 typedef struct {
     char *username;
     char *password;
-    hostdata_t *hostlist;
+    hostlist_t hostlist;
     char *mx;
     wc_state wildcard;
     backmx_state backmx;
     offline_state offline;
     dyndns_system system;
+    char *server;               /* base URL override or NULL */
 } dyndns_conf_t;
 
 extern dyndns_conf_t dyndns_conf;
-void init_dyndns_conf();
+extern provider_t dd_provider;
 
-void dd_work(char *curip);
+return_codes dyndns_classify(const char *tok, size_t len);
+size_t dyndns_parse_reply(const char *buf, size_t len, size_t chunk,
+                          return_codes *codes, size_t n);
 
 #endif
@@ -26,6 +26,7 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <curl/curl.h>
@@ -36,185 +37,204 @@
 #include "dns_helpers.h"
 #include "log.h"
 #include "util.h"
-#include "strl.h"
+#include "urlbuf.h"
 #include "malloc.h"
 
 he_conf_t he_conf;
 
-void init_he_conf()
+static void he_init(void *conf)
 {
-    he_conf.userid = NULL;
-    he_conf.passhash = NULL;
-    he_conf.hostpairs = NULL;
-    he_conf.tunlist = NULL;
+    he_conf_t *t = conf;
+
+    t->userid = NULL;
+    t->passhash = NULL;
+    memset(&t->hostpairs, 0, sizeof t->hostpairs);
+    memset(&t->tunlist, 0, sizeof t->tunlist);
+    t->server = NULL;
+    t->tunserver = NULL;
 }
 
-static void modify_he_hostip_in_list(hostdata_t *t, char *host, char *ip)
+/* returns 1 for valid config, 0 for invalid */
+static int he_tun_validate(void *conf, int hosts)
 {
-    if (!t || !host)
-        return;
-    for (; t && strcmp(t->host, host); t = t->next);
-    if (t) {
-        free(t->ip);
-        t->ip = NULL;
-        if (ip) {
-            size_t len = strlen(ip) + 1;
-            char *buf = xmalloc(len);
-            strnkcpy(buf, ip, len);
-            t->ip = buf;
+    he_conf_t *t = conf;
+    int r = 1;
+
+    if (hosts) {
+        if (t->userid == NULL) {
+            r = 0;
+            log_line("he config invalid: no userid provided");
+        }
+        if (t->passhash == NULL) {
+            r = 0;
+            log_line("he config invalid: no passhash provided");
         }
     }
+    return r;
 }
 
-static void modify_he_hostip_in_conf(he_conf_t *conf, char *host, char *ip)
+/* The [he] section configures both providers; each takes its own keys. */
+static const provider_key_t he_cfg_keys[] = {
+    { K_HOSTPAIRS, PK_HOSTPAIRS, 0, 0 },
+    { K_SERVER, PK_STRING, offsetof(he_conf_t, server), 0 },
+    PK_END
+};
+
+static const provider_key_t he_tun_cfg_keys[] = {
+    { K_PASSHASH, PK_STRING, offsetof(he_conf_t, passhash), 0 },
+    { K_TUNNELIDS, PK_HOSTS, 0, 0 },
+    { K_USERID, PK_STRING, offsetof(he_conf_t, userid), 0 },
+    { K_TUNNELSERVER, PK_STRING, offsetof(he_conf_t, tunserver), 0 },
+    PK_END
+};
+
+// "good x.x.x.x" is success
+static const char * const he_host_keys[] = { "good", NULL };
+
+/* Built once by he_compile().  The host's credentials go between the
+ * scheme and the server, so he_url holds the URL up to the credentials and
+ * he_rest the part from the server up to the host name. */
+static urlbuf_t he_url, he_rest;
+static size_t he_head_len;
+
+static void he_compile(void)
 {
-    if (conf)
-        modify_he_hostip_in_list(conf->hostpairs, host, ip);
+    urlbuf_t base;
+    char *p;
+
+    ub_trunc(&he_url, 0);
+    ub_trunc(&he_rest, 0);
+
+    memset(&base, 0, sizeof base);
+    ub_base(&base, he_conf.server, "dyn.dns.he.net", use_ssl);
+    p = strstr(base.buf, "://");
+    he_head_len = p ? (size_t)(p + 3 - base.buf) : 0;
+    ub_putn(&he_url, base.buf, he_head_len);
+    ub_puts(&he_rest, "@");
+    ub_putn(&he_rest, base.buf + he_head_len, base.len - he_head_len);
+    ub_puts(&he_rest, "/nic/update?hostname=");
+    ub_free(&base);
 }
 
-static void modify_he_hostdate_in_list(hostdata_t *t, char *host, time_t time)
+static char *he_build(hostdata_t *hd, char *curip)
 {
-    if (!t || !host)
-        return;
-    for (; t && strcmp(t->host, host); t = t->next);
-    if (t)
-        t->date = time;
+    char *host = hd->host, *password = hd->password;
+
+    if (!host || !password || !he_rest.len)
+        return NULL;
+
+    ub_trunc(&he_url, he_head_len);
+    ub_enc(&he_url, host);
+    ub_puts(&he_url, ":");
+    ub_enc(&he_url, password);
+    ub_cat(&he_url, &he_rest);
+    ub_enc(&he_url, host);
+    ub_puts(&he_url, "&myip=");
+    ub_puts(&he_url, curip);
+    return he_url.buf;
 }
 
-static void modify_he_hostdate_in_conf(he_conf_t *conf, char *host, time_t time)
+/* The A and AAAA records of a host are updated by separate requests; only
+ * the families whose address changed are sent. */
+provider_t he_provider = {
+    .name = "he",
+    .label = "he",
+    .section = K_HE_SECTION,
+    .ep = EP_HE_DNS,
+    .list = &he_conf.hostpairs,
+    .families = ADDR_V4 | ADDR_V6,
+    .verify = 1,
+    .conf = &he_conf,
+    .conf_size = sizeof (he_conf_t),
+    .keys = he_cfg_keys,
+    .reply_keys = he_host_keys,
+    .init = he_init,
+    .compile = he_compile,
+    .build = he_build,
+};
+
+enum { TUN_OK, TUN_NOCHG, TUN_ABUSE };
+
+static const char * const he_tun_keys[] = {
+    // "+OK: Tunnel endpoint updated to: x.x.x.x" is success
+    [TUN_OK] = "+OK",
+    [TUN_NOCHG] = "-ERROR: This tunnel is already associated with this IP address.",
+    [TUN_ABUSE] = "abuse",
+    NULL
+};
+
+static void he_tun_apply(hostdata_t *hd, char *curip, resp_t *resp)
 {
-    if (conf)
-        modify_he_hostdate_in_list(conf->hostpairs, host, time);
+    char *tunid = hd->host;
+
+    if (resp->match == TUN_OK) {
+        log_line("%s: [good] - Update successful.", tunid);
+        provider_updated(hd, curip);
+    } else if (resp->match == TUN_NOCHG) {
+        log_line("%s: [nochg] - Unnecessary update; further updates will be considered abusive." , tunid);
+        provider_updated(hd, curip);
+    } else if (resp->match == TUN_ABUSE) {
+        log_line("[%s] has a configuration problem.  Refusing to update until %s-dnserr is removed.", tunid, tunid);
+        write_dnserr(tunid, -2);
+        hostlist_remove(hd->list, hd);
+    } else {
+        provider_failed(hd);
+    }
 }
 
-static void he_update_host(char *host, char *password, char *curip)
-{
-    char url[MAX_BUF];
-    conn_data_t data;
+/* Built once by he_tun_compile(): tun_url holds the tunnel URL up to the
+ * address and tun_tail everything up to the id. */
+static urlbuf_t tun_url, tun_tail;
+static size_t tun_head_len;
 
-    if (!host || !password || !curip)
+static void he_tun_compile(void)
+{
+    ub_trunc(&tun_url, 0);
+    ub_trunc(&tun_tail, 0);
+    tun_head_len = 0;
+    if (!he_conf.userid || !he_conf.passhash)
         return;
 
-    /* set up the authentication url */
-    if (use_ssl)
-        DDCB_CPY(url, "https://");
-    else
-        DDCB_CPY(url, "http://");
-
-    DDCB_CAT(url, host);
-    DDCB_CAT(url, ":");
-    DDCB_CAT(url, password);
-
-    DDCB_CAT(url, "@dyn.dns.he.net/nic/update?hostname=");
-    DDCB_CAT(url, host);
-
-    DDCB_CAT(url, "&myip=");
-    DDCB_CAT(url, curip);
-
-    data.buf = xmalloc(MAX_CHUNKS * CURL_MAX_WRITE_SIZE + 1);
-    memset(data.buf, '\0', MAX_CHUNKS * CURL_MAX_WRITE_SIZE + 1);
-    data.buflen = MAX_CHUNKS * CURL_MAX_WRITE_SIZE + 1;
-    data.idx = 0;
-
-    if (!dyndns_curl_send(url, &data, NULL)) {
-        // "good x.x.x.x" is success
-        log_line("response returned: [%s]", data.buf);
-        if (strstr(data.buf, "good")) {
-            log_line("%s: [good] - Update successful.", host);
-            write_dnsip(host, curip);
-            write_dnsdate(host, clock_time());
-            modify_he_hostdate_in_conf(&he_conf, host, clock_time());
-            modify_he_hostip_in_conf(&he_conf, host, curip);
-        } else {
-            log_line("%s: [fail] - Failed to update.", host);
-        }
-    }
-    free(data.buf);
-}
+    ub_base(&tun_url, he_conf.tunserver, "ipv4.tunnelbroker.net", use_ssl);
+    ub_puts(&tun_url, "/ipv4_end.php?ip=");
+    tun_head_len = tun_url.len;
 
-void he_dns_work(char *curip)
-{
-    char host[MAX_BUF], *pass, *p;
-    for (hostdata_t *tp = he_conf.hostpairs; tp != NULL; tp = tp->next) {
-        if (strcmp(curip, tp->ip)) {
-            if (strnkcpy(host, tp->host, sizeof host))
-                goto too_short;
-            if (strnkcat(host, ":", sizeof host))
-                goto too_short;
-            if (strnkcat(host, tp->password, sizeof host)) {
-too_short:
-                log_line("he_dns_work: host+password is too long");
-                continue;
-            }
-            p = strchr(host, ':');
-            if (!p)
-                continue;
-            *p = '\0';
-            pass = p + 1;
-            log_line("adding for update [%s]", host);
-            he_update_host(host, pass, curip);
-        }
-    }
+    ub_puts(&tun_tail, "&pass=");
+    ub_enc(&tun_tail, he_conf.passhash);
+    ub_puts(&tun_tail, "&apikey=");
+    ub_enc(&tun_tail, he_conf.userid);
+    ub_puts(&tun_tail, "&tid=");
 }
 
-static void he_update_tunid(char *tunid, char *curip)
+static char *he_tun_build(hostdata_t *hd, char *curip)
 {
-    char url[MAX_BUF];
-    conn_data_t data;
+    char *tunid = hd->host;
 
-    if (!tunid || !curip)
-        return;
-
-    /* set up the authentication url */
-    if (use_ssl)
-        DDCB_CPY(url, "https");
-    else
-        DDCB_CPY(url, "http");
-    DDCB_CAT(url, "://ipv4.tunnelbroker.net/ipv4_end.php?ip=");
-    DDCB_CAT(url, curip);
-    DDCB_CAT(url, "&pass=");
-    DDCB_CAT(url, he_conf.passhash);
-    DDCB_CAT(url, "&apikey=");
-    DDCB_CAT(url, he_conf.userid);
-    DDCB_CAT(url, "&tid=");
-    DDCB_CAT(url, tunid);
-
-    data.buf = xmalloc(MAX_CHUNKS * CURL_MAX_WRITE_SIZE + 1);
-    memset(data.buf, '\0', MAX_CHUNKS * CURL_MAX_WRITE_SIZE + 1);
-    data.buflen = MAX_CHUNKS * CURL_MAX_WRITE_SIZE + 1;
-    data.idx = 0;
-
-    if (!dyndns_curl_send(url, &data, NULL)) {
-        // "+OK: Tunnel endpoint updated to: x.x.x.x" is success
-        log_line("response returned: [%s]", data.buf);
-        if (strstr(data.buf, "+OK")) {
-            log_line("%s: [good] - Update successful.", tunid);
-            write_dnsip(tunid, curip);
-            write_dnsdate(tunid, clock_time());
-            modify_he_hostdate_in_list(he_conf.tunlist, tunid, clock_time());
-            modify_he_hostip_in_list(he_conf.tunlist, tunid, curip);
-        } else if (strstr(data.buf, "-ERROR: This tunnel is already associated with this IP address.")) {
-            log_line("%s: [nochg] - Unnecessary update; further updates will be considered abusive." , tunid);
-            write_dnsip(tunid, curip);
-            write_dnsdate(tunid, clock_time());
-        } else if (strstr(data.buf, "abuse")) {
-            log_line("[%s] has a configuration problem.  Refusing to update until %s-dnserr is removed.", tunid, tunid);
-            write_dnserr(tunid, -2);
-            remove_host_from_hostdata_list(&he_conf.tunlist, tunid);
-        } else {
-            log_line("%s: [fail] - Failed to update.", tunid);
-        }
-    }
-    free(data.buf);
-}
+    if (!tunid || !tun_head_len)
+        return NULL;
 
-void he_tun_work(char *curip)
-{
-    for (hostdata_t *t = he_conf.tunlist; t != NULL; t = t->next) {
-        if (strcmp(curip, t->ip)) {
-            log_line("adding for update [%s]", t->host);
-            he_update_tunid(t->host, curip);
-        }
-    }
+    ub_trunc(&tun_url, tun_head_len);
+    ub_puts(&tun_url, curip);
+    ub_cat(&tun_url, &tun_tail);
+    ub_enc(&tun_url, tunid);
+    return tun_url.buf;
 }
 
+/* A tunnel's endpoint is always its IPv4 address. */
+provider_t he_tun_provider = {
+    .name = "he",
+    .label = "he-tunnel",
+    .section = K_HE_SECTION,
+    .ep = EP_HE_TUN,
+    .list = &he_conf.tunlist,
+    .families = ADDR_V4,
+    .conf = &he_conf,
+    .conf_size = sizeof (he_conf_t),
+    .keys = he_tun_cfg_keys,
+    .reply_keys = he_tun_keys,
+    .init = he_init,
+    .validate = he_tun_validate,
+    .compile = he_tun_compile,
+    .build = he_tun_build,
+    .apply = he_tun_apply,
+};
@@ -27,19 +27,19 @@
  */
 #ifndef NHEDNS_DNS_HE_H_
 #define NHEDNS_DNS_HE_H_
-#include "cfg.h"
+#include "provider.h"
 
 typedef struct {
     char *userid;
     char *passhash;
-    hostdata_t *hostpairs;
-    hostdata_t *tunlist;
+    hostlist_t hostpairs;
+    hostlist_t tunlist;
+    char *server;               /* base URL overrides or NULL */
+    char *tunserver;
 } he_conf_t;
 
 extern he_conf_t he_conf;
-void init_he_conf();
-
-void he_dns_work(char *curip);
-void he_tun_work(char *curip);
+extern provider_t he_provider;
+extern provider_t he_tun_provider;
 
 #endif
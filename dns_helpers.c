@@ -40,8 +40,10 @@
 #include "defines.h"
 #include "log.h"
 #include "strl.h"
-#include "malloc.h"
+#include "arena.h"
 #include "util.h"
+#include "transport.h"
+#include "state.h"
 
 static void write_dnsfile(char *fn, char *cnts)
 {
@@ -75,57 +77,38 @@ static void write_dnsfile(char *fn, char *cnts)
 
 void write_dnsdate(char *host, time_t date)
 {
-    int len;
-    char *file, buf[MAX_BUF];
-
     if (!host)
         suicide("%s: host is NULL", __func__);
-
-    len = strlen(host) + strlen("-dnsdate") + 5;
-    file = xmalloc(len);
-    strnkcpy(file, "var/", len);
-    strnkcat(file, host, len);
-    strnkcat(file, "-dnsdate", len);
-    buf[MAX_BUF - 1] = '\0';
-    snprintf(buf, sizeof buf - 1, "%u", (unsigned int)date);
-
-    write_dnsfile(file, buf);
-    free(file);
+    state_set_date(host, date);
 }
 
-/* assumes that if ip is non-NULL, it is valid */
+/* assumes that if ip is non-NULL, it is valid; it is recorded as the
+ * published address of its family */
 void write_dnsip(char *host, char *ip)
 {
-    int len;
-    char *file, buf[MAX_BUF];
-
     if (!host)
         suicide("%s: host is NULL", __func__);
     if (!ip)
         suicide("%s: ip is NULL", __func__);
-
-    len = strlen(host) + strlen("-dnsip") + 5;
-    file = xmalloc(len);
-    strnkcpy(file, "var/", len);
-    strnkcat(file, host, len);
-    strnkcat(file, "-dnsip", len);
-    strnkcpy(buf, ip, sizeof buf);
-
-    write_dnsfile(file, buf);
-    free(file);
+    if (ip_is_v6(ip))
+        state_set_ip6(host, ip);
+    else
+        state_set_ip(host, ip);
 }
 
-/* assumes that if ip is non-NULL, it is valid */
+/* Locks host against further updates.  The lock is kept in the state
+ * journal; the -dnserr file is written so that the user can clear the lock
+ * by removing it, as with earlier versions. */
 void write_dnserr(char *host, return_codes code)
 {
     int len;
-    char *file, buf[MAX_BUF], *error;
+    char *file, *error;
 
     if (!host)
         suicide("%s: host is NULL", __func__);
 
     len = strlen(host) + strlen("-dnserr") + 5;
-    file = xmalloc(len);
+    file = arena_alloc(len);
     strnkcpy(file, "var/", len);
     strnkcat(file, host, len);
     strnkcat(file, "-dnserr", len);
@@ -147,10 +130,9 @@ void write_dnserr(char *host, return_codes code)
             error = "unknown";
             break;
     }
-    strnkcpy(buf, error, sizeof buf);
 
-    write_dnsfile(file, buf);
-    free(file);
+    state_set_err(host, error);
+    write_dnsfile(file, error);
 }
 
 /* Returns 0 on success, 1 on temporary error, 2 on permanent error */
@@ -203,45 +185,77 @@ static int update_ip_curl_errcheck(int val, char *cerr)
     return 0;
 }
 
-void dyndns_curlbuf_cpy(char *dst, char *src, size_t size)
+/* As update_ip_curl_errcheck(), but also treats HTTP 429 and 5xx replies
+ * as temporary errors. */
+static int update_ip_errcheck(xfer_t *x)
 {
-    if (strnkcpy(dst, src, size))
-        suicide("%s: would overflow a fixed buffer", __func__);
+    int ret = update_ip_curl_errcheck(x->result, x->err);
+
+    if (!ret && (x->resp->status == 429 || x->resp->status >= 500)) {
+        log_line("Server returned HTTP %ld.  Queuing for retry.",
+                 x->resp->status);
+        ret = 1;
+    }
+    return ret;
 }
 
-void dyndns_curlbuf_cat(char *dst, char *src, size_t size)
+int dyndns_curl_send(endpoint_id ep, char *url, resp_t *resp, char *unpwd,
+                     char *iface)
 {
-    if (strnkcat(dst, src, size))
-        suicide("%s: would overflow a fixed buffer", __func__);
+    xfer_t x;
+
+    memset(&x, 0, sizeof x);
+    x.ep = ep;
+    x.url = url;
+    x.unpwd = unpwd;
+    x.iface = iface;
+    x.resp = resp;
+
+    log_line("update url: [%s]", url);
+    transport_perform(&x);
+    return update_ip_errcheck(&x);
 }
 
-int dyndns_curl_send(char *url, conn_data_t *data, char *unpwd)
+typedef struct {
+    xfer_t x;
+    resp_t resp;
+    dyndns_done_fn fn;
+    void *arg;
+} queued_req_t;
+
+static void queued_req_start(xfer_t *x)
 {
-    CURL *h;
-    CURLcode ret;
-    char useragent[64];
-    char curlerror[CURL_ERROR_SIZE];
+    log_line("update url: [%s]", x->url);
+}
 
-    /* set up useragent */
-    dyndns_curlbuf_cpy(useragent, "ndyndns/", sizeof useragent);
-    dyndns_curlbuf_cat(useragent, PACKAGE_VERSION, sizeof useragent);
+static void queued_req_done(xfer_t *x)
+{
+    queued_req_t *q = x->arg;
 
-    log_line("update url: [%s]", url);
-    h = curl_easy_init();
-    curl_easy_setopt(h, CURLOPT_URL, url);
-    curl_easy_setopt(h, CURLOPT_USERAGENT, useragent);
-    curl_easy_setopt(h, CURLOPT_ERRORBUFFER, curlerror);
-    curl_easy_setopt(h, CURLOPT_WRITEFUNCTION, write_response);
-    curl_easy_setopt(h, CURLOPT_WRITEDATA, data);
-    curl_easy_setopt(h, CURLOPT_PROTOCOLS, CURLPROTO_HTTP | CURLPROTO_HTTPS);
-    curl_easy_setopt(h, CURLOPT_REDIR_PROTOCOLS, CURLPROTO_HTTP | CURLPROTO_HTTPS);
-    if (unpwd) {
-        curl_easy_setopt(h, CURLOPT_USERPWD, unpwd);
-        curl_easy_setopt(h, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
-    }
-    curl_easy_setopt(h, CURLOPT_SSL_VERIFYPEER, (long)0);
-    ret = curl_easy_perform(h);
-    curl_easy_cleanup(h);
-    return update_ip_curl_errcheck(ret, curlerror);
+    q->fn(update_ip_errcheck(x), &q->resp, q->arg);
 }
 
+/* Queues a request for the next transport_run().  The request, and copies
+ * of url and unpwd, live in the cycle arena.  The body is matched against
+ * keys, or handed to feed with arg as its parser state, as it arrives; fn
+ * is called with the dyndns_curl_send()-style result code and the parsed
+ * response once the transfer completes. */
+void dyndns_curl_queue(endpoint_id ep, char *url, char *unpwd,
+                       const char * const *keys, resp_feed_fn feed,
+                       dyndns_done_fn fn, void *arg)
+{
+    queued_req_t *q = arena_alloc(sizeof (queued_req_t));
+
+    memset(q, 0, sizeof *q);
+    resp_init(&q->resp, keys, feed, arg);
+    q->fn = fn;
+    q->arg = arg;
+    q->x.ep = ep;
+    q->x.url = arena_strdup(url);
+    q->x.unpwd = unpwd ? arena_strdup(unpwd) : NULL;
+    q->x.resp = &q->resp;
+    q->x.start = queued_req_start;
+    q->x.done = queued_req_done;
+    q->x.arg = q;
+    transport_submit(&q->x);
+}
@@ -30,7 +30,9 @@
 #define NDYNDNS_DNS_HELPERS_H_
 
 #include <stdbool.h>
-#include "util.h" /* for conn_data_t */
+#include "transport.h"
+#include "response.h"
+#include "hostlist.h"
 
 extern int use_ssl;
 
@@ -54,13 +56,12 @@ typedef enum {
 void write_dnsdate(char *host, time_t date);
 void write_dnsip(char *host, char *ip);
 void write_dnserr(char *host, return_codes code);
-void dyndns_curlbuf_cpy(char *dst, char *src, size_t size);
-void dyndns_curlbuf_cat(char *dst, char *src, size_t size);
-int dyndns_curl_send(char *url, conn_data_t *data, char *unpwd);
+int dyndns_curl_send(endpoint_id ep, char *url, resp_t *resp, char *unpwd,
+                     char *iface);
 
-#define DDCB_CPY(dst, src) do { \
-    dyndns_curlbuf_cpy(dst, src, sizeof dst); } while (0)
-#define DDCB_CAT(dst, src) do { \
-    dyndns_curlbuf_cat(dst, src, sizeof dst); } while (0)
+typedef void (*dyndns_done_fn)(int ret, resp_t *resp, void *arg);
+void dyndns_curl_queue(endpoint_id ep, char *url, char *unpwd,
+                       const char * const *keys, resp_feed_fn feed,
+                       dyndns_done_fn fn, void *arg);
 
 #endif
@@ -26,6 +26,7 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <curl/curl.h>
@@ -36,147 +37,117 @@
 #include "dns_helpers.h"
 #include "log.h"
 #include "util.h"
-#include "strl.h"
+#include "urlbuf.h"
 #include "malloc.h"
 
 namecheap_conf_t namecheap_conf;
 
-void init_namecheap_conf()
+static void nc_init(void *conf)
 {
-    namecheap_conf.password = NULL;
-    namecheap_conf.hostlist = NULL;
+    namecheap_conf_t *t = conf;
+
+    t->password = NULL;
+    memset(&t->hostlist, 0, sizeof t->hostlist);
+    t->server = NULL;
 }
 
-static void modify_nc_hostip_in_list(namecheap_conf_t *conf, char *host,
-                                     char *ip)
+/* returns 1 for valid config, 0 for invalid */
+static int nc_validate(void *conf, int hosts)
 {
-    hostdata_t *t;
-    size_t len;
-    char *buf;
+    namecheap_conf_t *t = conf;
+    int r = 1;
 
-    if (!conf || !host || !conf->hostlist)
-        return;
+    if (t->password || hosts) {
+        if (t->password == NULL) {
+            r = 0;
+            log_line("namecheap config invalid: no password provided");
+        }
+        if (!hosts) {
+            r = 0;
+            log_line("namecheap config invalid: no hostnames provided");
+        }
+    }
+    return r;
+}
 
-    for (t = conf->hostlist; t && strcmp(t->host, host); t = t->next);
+static const provider_key_t nc_cfg_keys[] = {
+    { K_PASSWORD, PK_STRING, offsetof(namecheap_conf_t, password), 0 },
+    { K_HOSTS, PK_HOSTS, 0, 0 },
+    { K_SERVER, PK_STRING, offsetof(namecheap_conf_t, server), 0 },
+    PK_END
+};
 
-    if (!t)
-        return; /* not found */
+static const char * const nc_keys[] = { "<ErrCount>0", NULL };
 
-    free(t->ip);
-    if (!ip) {
-        t->ip = ip;
-        return;
-    }
-    len = strlen(ip) + 1;
-    buf = xmalloc(len);
-    strnkcpy(buf, ip, len);
-    t->ip = buf;
-}
+/* Built once by nc_compile(): nc_url holds the URL up to the host name
+ * and is cut back to it for each request. */
+static urlbuf_t nc_url, nc_tail;
+static size_t nc_head_len;
 
-static void modify_nc_hostdate_in_list(namecheap_conf_t *conf, char *host,
-                                       time_t time)
+static void nc_compile(void)
 {
-    hostdata_t *t;
-
-    if (!conf || !host || !conf->hostlist)
+    ub_trunc(&nc_url, 0);
+    ub_trunc(&nc_tail, 0);
+    nc_head_len = 0;
+    if (!namecheap_conf.password)
         return;
 
-    for (t = conf->hostlist; t && strcmp(t->host, host); t = t->next);
-
-    if (!t)
-        return; /* not found */
+    ub_base(&nc_url, namecheap_conf.server,
+            "dynamicdns.park-your-domain.com", use_ssl);
+    ub_puts(&nc_url, "/update?host=");
+    nc_head_len = nc_url.len;
 
-    t->date = time;
+    ub_puts(&nc_tail, "&password=");
+    ub_enc(&nc_tail, namecheap_conf.password);
+    ub_puts(&nc_tail, "&ip=");
 }
 
-static void nc_update_host(char *host, char *curip)
+/* Namecheap takes the domain (the last two labels) and the name within it
+ * separately; '@' names the domain itself. */
+static char *nc_build(hostdata_t *hd, char *curip)
 {
-    int hostname_size = 0, domain_size = 0, dotc = 0;
-    char url[MAX_BUF];
-    char *hostname = NULL, *domain = NULL;
-    size_t ic;
-    conn_data_t data;
+    char *host = hd->host, *domain = NULL, *p;
+    int dotc = 0;
 
-    if (!host || !curip)
-        return;
+    if (!host || !nc_head_len)
+        return NULL;
 
-    ic = strlen(host);
-    if (strnkcpy(url, host, sizeof url)) {
-        log_line("nc_update_host: hostname is too long");
-        return;
-    }
-    for (; ic > 0; --ic) {
-        if (url[ic] == '.') {
-            ++dotc;
-            if (dotc == 2) {
-                // This is the . before the domain name.
-                domain_size = strlen(url+ic+1) + 1;
-                domain = xmalloc(domain_size);
-                strnkcpy(domain, url+ic+1, domain_size);
-                url[ic] = '\0';
-            }
-        }
-    }
-    if (dotc >= 2) {
-        hostname_size = strlen(url) + 1;
-        hostname = xmalloc(hostname_size);
-        strnkcpy(hostname, url, hostname_size);
-    } else {
-        domain_size = strlen(url) + 1;
-        domain = xmalloc(domain_size);
-        strnkcpy(domain, url, domain_size);
-        hostname_size = 2;
-        hostname = xmalloc(hostname_size);
-        hostname[0] = '@';
-        hostname[1] = '\0';
-    }
-    memset(url, 0, sizeof url);
-
-    /* set up the authentication url */
-    if (use_ssl)
-        DDCB_CPY(url, "https");
-    else
-        DDCB_CPY(url, "http");
-    DDCB_CAT(url, "://dynamicdns.park-your-domain.com/update?");
-    DDCB_CAT(url, "host=");
-    DDCB_CAT(url, hostname);
-    DDCB_CAT(url, "&domain=");
-    DDCB_CAT(url, domain);
-    DDCB_CAT(url, "&password=");
-    DDCB_CAT(url, namecheap_conf.password);
-    DDCB_CAT(url, "&ip=");
-    DDCB_CAT(url, curip);
-
-    data.buf = xmalloc(MAX_CHUNKS * CURL_MAX_WRITE_SIZE + 1);
-    memset(data.buf, '\0', MAX_CHUNKS * CURL_MAX_WRITE_SIZE + 1);
-    data.buflen = MAX_CHUNKS * CURL_MAX_WRITE_SIZE + 1;
-    data.idx = 0;
-
-    if (!dyndns_curl_send(url, &data, NULL)) {
-        log_line("response returned: [%s]", data.buf);
-        if (strstr(data.buf, "<ErrCount>0")) {
-            log_line("%s: [good] - Update successful.", host);
-            write_dnsip(host, curip);
-            write_dnsdate(host, clock_time());
-            modify_nc_hostdate_in_list(&namecheap_conf, host, clock_time());
-            modify_nc_hostip_in_list(&namecheap_conf, host, curip);
-        } else {
-            log_line("%s: [fail] - Failed to update.", host);
+    for (p = host + strlen(host); p > host; --p) {
+        if (*p == '.' && ++dotc == 2) {
+            domain = p;
+            break;
         }
     }
-    free(data.buf);
-    free(hostname);
-    free(domain);
-}
 
-void nc_work(char *curip)
-{
-    for (hostdata_t *t = namecheap_conf.hostlist; t != NULL; t = t->next) {
-        if (strcmp(curip, t->ip)) {
-            log_line("adding for update [%s]", t->host);
-            nc_update_host(t->host, curip);
-        }
+    ub_trunc(&nc_url, nc_head_len);
+    if (domain) {
+        ub_encn(&nc_url, host, domain - host);
+        ub_puts(&nc_url, "&domain=");
+        ub_enc(&nc_url, domain + 1);
+    } else {
+        ub_puts(&nc_url, "@&domain=");
+        ub_enc(&nc_url, host);
     }
+    ub_cat(&nc_url, &nc_tail);
+    ub_puts(&nc_url, curip);
+    return nc_url.buf;
 }
 
-
+/* The Namecheap dynamic DNS interface only updates A records. */
+provider_t nc_provider = {
+    .name = "namecheap",
+    .label = "namecheap",
+    .section = K_NAMECHEAP_SECTION,
+    .ep = EP_NAMECHEAP,
+    .list = &namecheap_conf.hostlist,
+    .families = ADDR_V4,
+    .verify = 1,
+    .conf = &namecheap_conf,
+    .conf_size = sizeof (namecheap_conf_t),
+    .keys = nc_cfg_keys,
+    .reply_keys = nc_keys,
+    .init = nc_init,
+    .validate = nc_validate,
+    .compile = nc_compile,
+    .build = nc_build,
+};
@@ -29,17 +29,16 @@
 #ifndef NNCDNS_DNS_NC_H_
 #define NNCDNS_DNS_NC_H_
 
-#include "cfg.h"
+#include "provider.h"
 
 typedef struct {
     char *password;
-    hostdata_t *hostlist;
+    hostlist_t hostlist;
+    char *server;               /* base URL override or NULL */
 } namecheap_conf_t;
 
 extern namecheap_conf_t namecheap_conf;
-void init_namecheap_conf();
-
-void nc_work(char *curip);
+extern provider_t nc_provider;
 
 #endif
 
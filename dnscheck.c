@@ -0,0 +1,842 @@
+/* dnscheck.c - verify published records against authoritative DNS
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "defines.h"
+#include "dnscheck.h"
+#include "source.h"
+#include "util.h"
+#include "log.h"
+#include "strl.h"
+#include "malloc.h"
+
+/*
+ * The address that a host was last published with is cached, so a record
+ * that is changed behind our back is never noticed.  When enabled, every
+ * DNSCHECK_INTERVAL seconds the A (and, for IPv6 sources, AAAA) record of
+ * each managed name is asked for directly: of the configured servers, or
+ * else of the authoritative servers of the name's zone, so that no cache
+ * stands in between.  All queries go out over one UDP socket per family,
+ * at most DNSCHECK_MAX_INFLIGHT at a time.  A host whose answer differs
+ * from the cached address has the cache corrected and its group rescanned,
+ * so that the providers update exactly the names that need it.
+ *
+ * A zone's servers are found once a day through the system resolver: the
+ * SOA record in the answer to a query for the name gives the zone, and
+ * the zone's NS records give the servers.  Names below a zone that is
+ * already known are assumed to be in it.  A zone that cannot be found is
+ * remembered as failed, under the parent of the name when not even its
+ * SOA record came back, and is not asked about again for
+ * DNSCHECK_ZONE_RETRY seconds.  Finding zones may take DNSCHECK_ZONE_BUDGET
+ * seconds and a whole check DNSCHECK_DEADLINE seconds; hosts left over then
+ * wait for the next check, so that an unreachable resolver or zone cannot
+ * hold up updates.
+ */
+
+#define DNS_HDR_LEN 12
+#define DNS_MAX_MSG 1232
+#define DNS_MAX_NAME 256
+#define DNS_T_A 1
+#define DNS_T_NS 2
+#define DNS_T_CNAME 5
+#define DNS_T_SOA 6
+#define DNS_T_AAAA 28
+#define DNS_RCODE_NXDOMAIN 3
+
+#ifndef RESOLV_CONF
+#define RESOLV_CONF "/etc/resolv.conf"
+#endif
+
+typedef struct {
+    struct sockaddr_storage addr[DNSCHECK_MAX_SERVERS];
+    socklen_t addrlen[DNSCHECK_MAX_SERVERS];
+    int n;
+    int rd;                     /* servers recurse for us */
+} servers_t;
+
+typedef struct zone {
+    char *name;
+    servers_t srv;              /* n is 0 if the zone could not be found */
+    time_t found;               /* monotonic */
+    struct zone *next;
+} zone_t;
+
+typedef struct {
+    int rcode;
+    int alias;                  /* the name is a CNAME */
+    int naddr;
+    char addr[DNSCHECK_MAX_ADDRS][INET6_ADDRSTRLEN];
+    char soa[DNS_MAX_NAME];     /* owner of the first SOA record */
+    int nns;
+    char ns[DNSCHECK_MAX_SERVERS][DNS_MAX_NAME];
+} dns_answer_t;
+
+static int enabled;
+static servers_t configured = { .rd = 1 };
+static zone_t *zones;
+static time_t next_run;
+static uint64_t id_state;       /* xorshift64* state for query IDs */
+
+/* Seeds the query ID generator from /dev/urandom, falling back to the
+ * clock and pid if it cannot be read, as may happen inside the chroot. */
+static void id_seed(void)
+{
+    int fd;
+
+    fd = open("/dev/urandom", O_RDONLY);
+    if (fd != -1) {
+        if (read(fd, &id_state, sizeof id_state) != sizeof id_state)
+            id_state = 0;
+        close(fd);
+    }
+    if (!id_state)
+        id_state = ((uint64_t)clock_mono() << 32) ^ (uint64_t)time(NULL) ^
+            (uint64_t)getpid() ^ 0x9e3779b97f4a7c15ULL;
+}
+
+/* Called while the config is read, so normally before imprisonment. */
+void dnscheck_enable(void)
+{
+    enabled = 1;
+    if (!id_state)
+        id_seed();
+}
+
+/* Parses ADDR, ADDR:PORT or [ADDR]:PORT into ss. */
+static int parse_server(char *spec, struct sockaddr_storage *ss,
+                        socklen_t *len)
+{
+    char buf[INET6_ADDRSTRLEN + 8], *host = buf, *port = NULL, *p;
+    struct sockaddr_in *sin = (struct sockaddr_in *)ss;
+    struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)ss;
+    int portnum = 53;
+
+    if (strnkcpy(buf, spec, sizeof buf))
+        return -1;
+    if (buf[0] == '[') {
+        ++host;
+        p = strchr(host, ']');
+        if (!p)
+            return -1;
+        *p++ = '\0';
+        if (*p == ':')
+            port = p + 1;
+    } else if ((p = strchr(host, ':')) && !strchr(p + 1, ':')) {
+        *p = '\0';
+        port = p + 1;
+    }
+    if (port) {
+        portnum = atoi(port);
+        if (portnum <= 0 || portnum > 65535)
+            return -1;
+    }
+
+    memset(ss, 0, sizeof *ss);
+    if (inet_pton(AF_INET, host, &sin->sin_addr) == 1) {
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(portnum);
+        *len = sizeof *sin;
+    } else if (inet_pton(AF_INET6, host, &sin6->sin6_addr) == 1) {
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = htons(portnum);
+        *len = sizeof *sin6;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+void dnscheck_add_server(char *spec)
+{
+    servers_t *s = &configured;
+
+    if (s->n == DNSCHECK_MAX_SERVERS)
+        suicide("Too many dnsserver lines; at most %d are used.  Exiting.",
+                DNSCHECK_MAX_SERVERS);
+    if (parse_server(spec, &s->addr[s->n], &s->addrlen[s->n]))
+        suicide("dnsserver [%s] is not an address.  Exiting.", spec);
+    ++s->n;
+    enabled = 1;
+}
+
+/* Writes name to p in wire form.  Returns its length, or 0 if it is not a
+ * valid domain name. */
+static size_t put_name(unsigned char *p, size_t size, const char *name)
+{
+    size_t n = 0, l;
+    const char *dot;
+
+    while (*name) {
+        dot = strchr(name, '.');
+        l = dot ? (size_t)(dot - name) : strlen(name);
+        if (!l || l > 63 || n + l + 2 > size)
+            return 0;
+        p[n++] = l;
+        memcpy(p + n, name, l);
+        n += l;
+        name += l;
+        if (*name == '.')
+            ++name;
+    }
+    if (n + 1 > size)
+        return 0;
+    p[n++] = 0;
+    return n;
+}
+
+static size_t build_query(unsigned char *buf, size_t size, unsigned int id,
+                          const char *name, int type, int rd)
+{
+    size_t n;
+
+    if (size < DNS_HDR_LEN + 4)
+        return 0;
+    memset(buf, 0, DNS_HDR_LEN);
+    buf[0] = id >> 8;
+    buf[1] = id & 0xff;
+    buf[2] = rd ? 0x01 : 0x00;
+    buf[5] = 1;                 /* one question */
+    n = put_name(buf + DNS_HDR_LEN, size - DNS_HDR_LEN - 4, name);
+    if (!n)
+        return 0;
+    n += DNS_HDR_LEN;
+    buf[n++] = type >> 8;
+    buf[n++] = type & 0xff;
+    buf[n++] = 0;
+    buf[n++] = 1;               /* class IN */
+    return n;
+}
+
+/* Reads the possibly compressed name at *off into out, in dotted form
+ * without the trailing dot, and moves *off past it. */
+static int get_name(const unsigned char *msg, size_t len, size_t *off,
+                    char *out, size_t outlen)
+{
+    size_t p = *off, o = 0, l;
+    int hops = 0, jumped = 0;
+
+    while (1) {
+        if (p >= len)
+            return -1;
+        l = msg[p];
+        if ((l & 0xc0) == 0xc0) {
+            if (p + 1 >= len || ++hops > 16)
+                return -1;
+            if (!jumped)
+                *off = p + 2;
+            jumped = 1;
+            p = ((l & 0x3f) << 8) | msg[p + 1];
+            continue;
+        }
+        if (l & 0xc0)
+            return -1;
+        ++p;
+        if (!l)
+            break;
+        if (p + l > len || o + l + 2 > outlen)
+            return -1;
+        if (o)
+            out[o++] = '.';
+        memcpy(out + o, msg + p, l);
+        o += l;
+        p += l;
+    }
+    out[o] = '\0';
+    if (!jumped)
+        *off = p;
+    return 0;
+}
+
+static int name_eq(const char *a, const char *b)
+{
+    size_t la = strlen(a), lb = strlen(b);
+
+    if (la && a[la - 1] == '.')
+        --la;
+    if (lb && b[lb - 1] == '.')
+        --lb;
+    return la == lb && !strncasecmp(a, b, la);
+}
+
+/* Returns the id of msg, or -1 if it is too short to be a reply. */
+static int reply_id(const unsigned char *msg, size_t len)
+{
+    if (len < DNS_HDR_LEN || !(msg[2] & 0x80))
+        return -1;
+    return (msg[0] << 8) | msg[1];
+}
+
+/* Parses the reply msg to a query for qname and qtype.  Returns 0 on
+ * success, or -1 if it is malformed, truncated or answers some other
+ * question. */
+static int parse_reply(const unsigned char *msg, size_t len,
+                       const char *qname, int qtype, dns_answer_t *a)
+{
+    char name[DNS_MAX_NAME];
+    size_t off = DNS_HDR_LEN;
+    unsigned int qd, rrs, i, rdlen;
+    int type;
+
+    memset(a, 0, sizeof *a);
+    if (len < DNS_HDR_LEN)
+        return -1;
+    if (msg[2] & 0x02) {
+        log_line("dnscheck: the answer for [%s] was truncated.", qname);
+        return -1;
+    }
+    a->rcode = msg[3] & 0x0f;
+    qd = (msg[4] << 8) | msg[5];
+    rrs = ((msg[6] << 8) | msg[7]) + ((msg[8] << 8) | msg[9]);
+    if (qd != 1)
+        return -1;
+    if (get_name(msg, len, &off, name, sizeof name) || off + 4 > len)
+        return -1;
+    if (!name_eq(name, qname) || ((msg[off] << 8) | msg[off + 1]) != qtype)
+        return -1;
+    off += 4;
+
+    /* answer and authority sections */
+    for (i = 0; i < rrs; ++i) {
+        if (get_name(msg, len, &off, name, sizeof name) || off + 10 > len)
+            return -1;
+        type = (msg[off] << 8) | msg[off + 1];
+        rdlen = (msg[off + 8] << 8) | msg[off + 9];
+        off += 10;
+        if (off + rdlen > len)
+            return -1;
+        if (type == DNS_T_SOA && !a->soa[0]) {
+            strnkcpy(a->soa, name, sizeof a->soa);
+        } else if (!name_eq(name, qname)) {
+            ;
+        } else if (type == DNS_T_CNAME) {
+            a->alias = 1;
+        } else if (type == qtype && type == DNS_T_A && rdlen == 4 &&
+                   a->naddr < DNSCHECK_MAX_ADDRS) {
+            inet_ntop(AF_INET, msg + off, a->addr[a->naddr++],
+                      INET6_ADDRSTRLEN);
+        } else if (type == qtype && type == DNS_T_AAAA && rdlen == 16 &&
+                   a->naddr < DNSCHECK_MAX_ADDRS) {
+            inet_ntop(AF_INET6, msg + off, a->addr[a->naddr++],
+                      INET6_ADDRSTRLEN);
+        } else if (type == qtype && type == DNS_T_NS &&
+                   a->nns < DNSCHECK_MAX_SERVERS) {
+            size_t p = off;
+            if (!get_name(msg, len, &p, a->ns[a->nns], DNS_MAX_NAME))
+                ++a->nns;
+        }
+        off += rdlen;
+    }
+    return 0;
+}
+
+static int sockaddr_eq(struct sockaddr_storage *a, struct sockaddr_storage *b)
+{
+    if (a->ss_family != b->ss_family)
+        return 0;
+    if (a->ss_family == AF_INET) {
+        struct sockaddr_in *x = (struct sockaddr_in *)a;
+        struct sockaddr_in *y = (struct sockaddr_in *)b;
+        return x->sin_port == y->sin_port &&
+            x->sin_addr.s_addr == y->sin_addr.s_addr;
+    }
+    if (a->ss_family == AF_INET6) {
+        struct sockaddr_in6 *x = (struct sockaddr_in6 *)a;
+        struct sockaddr_in6 *y = (struct sockaddr_in6 *)b;
+        return x->sin6_port == y->sin6_port &&
+            !memcmp(&x->sin6_addr, &y->sin6_addr, sizeof x->sin6_addr);
+    }
+    return 0;
+}
+
+/* Query IDs come from a private generator so that nothing else that
+ * draws from random() can make them predictable. */
+static unsigned int next_id(void)
+{
+    if (!id_state)
+        id_seed();
+    id_state ^= id_state >> 12;
+    id_state ^= id_state << 25;
+    id_state ^= id_state >> 27;
+    return (unsigned int)((id_state * 0x2545f4914f6cdd1dULL) >> 48);
+}
+
+static time_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Asks one question of the servers in srv in turn, waiting for each
+ * answer, but not past deadline (ms).  Only used to find zones, which
+ * happens rarely. */
+static int ask(servers_t *srv, const char *name, int type, dns_answer_t *a,
+               time_t deadline)
+{
+    unsigned char q[DNS_MAX_MSG], r[DNS_MAX_MSG];
+    struct sockaddr_storage from;
+    socklen_t fromlen;
+    struct pollfd pfd;
+    size_t qlen;
+    ssize_t n;
+    unsigned int id;
+    time_t left;
+    int i, try, fd, timeout = DNSCHECK_RTO;
+
+    for (try = 0; try < DNSCHECK_TRIES; ++try, timeout *= 2) {
+        for (i = 0; i < srv->n; ++i) {
+            left = deadline - now_ms();
+            if (left <= 0)
+                return -1;
+            id = next_id();
+            qlen = build_query(q, sizeof q, id, name, type, srv->rd);
+            if (!qlen)
+                return -1;
+            fd = socket(srv->addr[i].ss_family, SOCK_DGRAM, 0);
+            if (fd == -1)
+                continue;
+            if (sendto(fd, q, qlen, 0, (struct sockaddr *)&srv->addr[i],
+                       srv->addrlen[i]) != (ssize_t)qlen) {
+                close(fd);
+                continue;
+            }
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            while (poll(&pfd, 1, left < timeout ? (int)left : timeout) > 0) {
+                fromlen = sizeof from;
+                n = recvfrom(fd, r, sizeof r, 0, (struct sockaddr *)&from,
+                             &fromlen);
+                if (n == -1)
+                    break;
+                if (!sockaddr_eq(&from, &srv->addr[i]) ||
+                    reply_id(r, n) != (int)id)
+                    continue;
+                if (!parse_reply(r, n, name, type, a)) {
+                    close(fd);
+                    return 0;
+                }
+                break;
+            }
+            close(fd);
+        }
+    }
+    return -1;
+}
+
+/* The first nameserver of resolv.conf, or the local host. */
+static void system_resolver(servers_t *srv)
+{
+    char buf[MAX_BUF], *p;
+    FILE *f;
+
+    memset(srv, 0, sizeof *srv);
+    srv->rd = 1;
+    f = fopen(RESOLV_CONF, "r");
+    if (f) {
+        while (fgets(buf, sizeof buf, f)) {
+            null_crlf(buf);
+            if (strncmp(buf, "nameserver", 10) ||
+                !isspace((unsigned char)buf[10]))
+                continue;
+            for (p = buf + 10; isspace((unsigned char)*p); ++p);
+            if (!parse_server(p, &srv->addr[0], &srv->addrlen[0])) {
+                srv->n = 1;
+                break;
+            }
+        }
+        fclose(f);
+    }
+    if (!srv->n) {
+        parse_server("127.0.0.1", &srv->addr[0], &srv->addrlen[0]);
+        srv->n = 1;
+    }
+}
+
+/* Returns 1 if host is zone or lies below it. */
+static int in_zone(const char *host, const char *zone)
+{
+    size_t lh = strlen(host), lz = strlen(zone);
+
+    if (!lz)
+        return 1;
+    if (lh < lz || strcasecmp(host + lh - lz, zone))
+        return 0;
+    return lh == lz || host[lh - lz - 1] == '.';
+}
+
+/* Remembers that the zone of the names at or below name cannot be found
+ * for now. */
+static void zone_failed(const char *name, time_t now)
+{
+    zone_t *z = xmalloc(sizeof (zone_t));
+
+    memset(z, 0, sizeof *z);
+    z->name = strdup(name);
+    z->found = now;
+    z->next = zones;
+    zones = z;
+}
+
+/* Returns the zone that host lies in, finding it if need be, or NULL if it
+ * cannot be found or deadline (ms) has passed. */
+static zone_t *zone_for(const char *host, time_t now, time_t deadline)
+{
+    servers_t res;
+    dns_answer_t a, b;
+    zone_t *z, *best = NULL, **p;
+    const char *parent;
+    size_t lz, lb = 0;
+    int i;
+
+    for (p = &zones; *p; ) {
+        z = *p;
+        if (now - z->found >= (z->srv.n ? DNSCHECK_ZONE_TTL :
+                               DNSCHECK_ZONE_RETRY)) {
+            *p = z->next;
+            free(z->name);
+            free(z);
+            continue;
+        }
+        lz = strlen(z->name);
+        if (in_zone(host, z->name) &&
+            (!best || lz > lb || (lz == lb && z->srv.n))) {
+            best = z;
+            lb = lz;
+        }
+        p = &z->next;
+    }
+    if (best)
+        return best->srv.n ? best : NULL;
+    if (now_ms() >= deadline)
+        return NULL;
+
+    system_resolver(&res);
+    if (ask(&res, host, DNS_T_SOA, &a, deadline) || !a.soa[0]) {
+        if (now_ms() >= deadline)
+            return NULL;
+        /* The names beside host most likely fail alike. */
+        parent = strchr(host, '.');
+        parent = parent && strchr(parent + 1, '.') ? parent + 1 : host;
+        log_line("dnscheck: cannot find the zone of [%s].  Not checking "
+                 "[%s] for now.", host, parent);
+        zone_failed(parent, now);
+        return NULL;
+    }
+    if (ask(&res, a.soa, DNS_T_NS, &b, deadline) || !b.nns) {
+        if (now_ms() >= deadline)
+            return NULL;
+        log_line("dnscheck: cannot find the servers of zone [%s].", a.soa);
+        zone_failed(a.soa, now);
+        return NULL;
+    }
+
+    z = xmalloc(sizeof (zone_t));
+    memset(z, 0, sizeof *z);
+    for (i = 0; i < b.nns && z->srv.n < DNSCHECK_MAX_SERVERS; ++i) {
+        dns_answer_t c;
+        struct sockaddr_in *sin = (struct sockaddr_in *)&z->srv.addr[z->srv.n];
+
+        if (ask(&res, b.ns[i], DNS_T_A, &c, deadline) || !c.naddr)
+            continue;
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(53);
+        inet_pton(AF_INET, c.addr[0], &sin->sin_addr);
+        z->srv.addrlen[z->srv.n++] = sizeof *sin;
+    }
+    if (!z->srv.n) {
+        free(z);
+        if (now_ms() >= deadline)
+            return NULL;
+        log_line("dnscheck: no server of zone [%s] has an address.", a.soa);
+        zone_failed(a.soa, now);
+        return NULL;
+    }
+    z->name = strdup(a.soa);
+    z->found = now;
+    z->next = zones;
+    zones = z;
+    log_line("dnscheck: zone [%s] has %d servers.", z->name, z->srv.n);
+    return z;
+}
+
+typedef struct {
+    hostdata_t *hd;
+    int type;
+    servers_t *srv;
+    int server;                 /* index into srv of the last send */
+    int tries;
+    unsigned int id;
+    time_t sent;                /* ms */
+    int state;                  /* 0 waiting, 1 in flight, 2 finished */
+} dq_t;
+
+static int dq_send(dq_t *q, int *fds)
+{
+    unsigned char buf[DNS_MAX_MSG];
+    struct sockaddr_storage *to;
+    size_t len;
+    int fi;
+
+    q->server = (q->server + (q->tries ? 1 : 0)) % q->srv->n;
+    to = &q->srv->addr[q->server];
+    fi = to->ss_family == AF_INET6;
+    if (fds[fi] == -1) {
+        fds[fi] = socket(to->ss_family, SOCK_DGRAM, 0);
+        if (fds[fi] == -1) {
+            log_line("dnscheck: failed to open socket: %s", strerror(errno));
+            return -1;
+        }
+    }
+    q->id = next_id();
+    len = build_query(buf, sizeof buf, q->id, q->hd->host, q->type,
+                      q->srv->rd);
+    if (!len)
+        return -1;
+    ++q->tries;
+    q->sent = now_ms();
+    q->state = 1;
+    sendto(fds[fi], buf, len, 0, (struct sockaddr *)to,
+           q->srv->addrlen[q->server]);
+    return 0;
+}
+
+/* Corrects hd's cached address if the answer disagrees with it. */
+static void dq_apply(dq_t *q, dns_answer_t *a)
+{
+    hostdata_t *hd = q->hd;
+    char **cur = q->type == DNS_T_AAAA ? &hd->ip6 : &hd->ip;
+    int i;
+
+    if (a->alias) {
+        log_line("dnscheck: [%s] is an alias; not checking it.", hd->host);
+        return;
+    }
+    if (a->rcode && a->rcode != DNS_RCODE_NXDOMAIN) {
+        log_line("dnscheck: server error %d for [%s].", a->rcode, hd->host);
+        return;
+    }
+    for (i = 0; i < a->naddr; ++i)
+        if (*cur && !strcmp(*cur, a->addr[i]))
+            return;
+    if (!a->naddr && !*cur)
+        return;
+
+    log_line("dnscheck: [%s] is published as [%s], not [%s].", hd->host,
+             a->naddr ? a->addr[0] : "nothing", *cur ? *cur : "nothing");
+    addr_set(cur, a->naddr ? a->addr[0] : NULL);
+    hostlist_rescan(hd);
+}
+
+static void dq_reply(dq_t *qs, size_t n, int fd)
+{
+    unsigned char buf[DNS_MAX_MSG];
+    struct sockaddr_storage from;
+    socklen_t fromlen;
+    dns_answer_t a;
+    ssize_t r;
+    size_t i;
+    int id;
+
+    while (1) {
+        fromlen = sizeof from;
+        r = recvfrom(fd, buf, sizeof buf, MSG_DONTWAIT,
+                     (struct sockaddr *)&from, &fromlen);
+        if (r == -1)
+            return;
+        id = reply_id(buf, r);
+        for (i = 0; i < n; ++i) {
+            dq_t *q = &qs[i];
+            if (q->state != 1 || (int)q->id != id ||
+                !sockaddr_eq(&from, &q->srv->addr[q->server]))
+                continue;
+            if (parse_reply(buf, r, q->hd->host, q->type, &a))
+                break;
+            q->state = 2;
+            dq_apply(q, &a);
+            break;
+        }
+    }
+}
+
+/* Whether hd's records are worth asking for: it must have a usable name
+ * and must not have been updated so recently that the change might not
+ * have reached every server yet. */
+static int checkable(hostdata_t *hd, time_t wall)
+{
+    const char *p;
+
+    if (wall - hd->date < DNSCHECK_GRACE)
+        return 0;
+    for (p = hd->host; *p; ++p)
+        if (!isalnum((unsigned char)*p) && *p != '-' && *p != '.' &&
+            *p != '_')
+            return 0;
+    return p != hd->host;
+}
+
+/* Checks the records of the hosts in the NULL-terminated lists if a check
+ * is due. */
+void dnscheck_run(hostlist_t **lists)
+{
+    time_t now = clock_mono(), wall = clock_time(), t, deadline, zdeadline;
+    size_t n = 0, i, next = 0, inflight = 0, answered = 0;
+    hostlist_t **l;
+    hostdata_t *hd;
+    dq_t *qs;
+    zone_t *z;
+    int fds[2] = { -1, -1 }, timeout, late = 0;
+
+    if (!enabled || now < next_run)
+        return;
+    next_run = now + DNSCHECK_INTERVAL;
+
+    for (l = lists; *l; ++l)
+        for (hd = (*l)->head; hd; hd = hd->next)
+            n += hd->src && hd->src->ipv6 ? 2 : 1;
+    if (!n)
+        return;
+    qs = xmalloc(n * sizeof (dq_t));
+    memset(qs, 0, n * sizeof (dq_t));
+    deadline = now_ms() + DNSCHECK_DEADLINE * 1000;
+    zdeadline = now_ms() + DNSCHECK_ZONE_BUDGET * 1000;
+
+    n = 0;
+    for (l = lists; *l; ++l) {
+        for (hd = (*l)->head; hd; hd = hd->next) {
+            servers_t *srv = &configured;
+            if (!checkable(hd, wall))
+                continue;
+            if (!srv->n) {
+                z = zone_for(hd->host, now, zdeadline);
+                if (!z) {
+                    late = late || now_ms() >= zdeadline;
+                    continue;
+                }
+                srv = &z->srv;
+            }
+            qs[n].hd = hd;
+            qs[n].type = DNS_T_A;
+            qs[n++].srv = srv;
+            if (hd->src && hd->src->ipv6) {
+                qs[n].hd = hd;
+                qs[n].type = DNS_T_AAAA;
+                qs[n++].srv = srv;
+            }
+        }
+    }
+
+    if (late)
+        log_line("dnscheck: out of time finding zones; the remaining hosts "
+                 "wait for the next check.");
+
+    while (answered < n) {
+        struct pollfd pfd[2];
+        int np = 0;
+
+        if (now_ms() >= deadline) {
+            log_line("dnscheck: out of time; giving up on %lu queries.",
+                     (unsigned long)(n - answered));
+            break;
+        }
+
+        /* fill the window, then retransmit or give up on the overdue */
+        for (; next < n && inflight < DNSCHECK_MAX_INFLIGHT; ++next) {
+            if (dq_send(&qs[next], fds))
+                qs[next].state = 2;
+            else
+                ++inflight;
+        }
+        t = now_ms();
+        timeout = DNSCHECK_RTO << (DNSCHECK_TRIES - 1);
+        answered = 0;
+        inflight = 0;
+        for (i = 0; i < n; ++i) {
+            dq_t *q = &qs[i];
+            int rto;
+
+            if (q->state == 2) {
+                ++answered;
+                continue;
+            }
+            if (q->state != 1)
+                continue;
+            rto = DNSCHECK_RTO << (q->tries - 1);
+            if (t - q->sent >= rto) {
+                if (q->tries >= DNSCHECK_TRIES) {
+                    log_line("dnscheck: no answer for [%s].", q->hd->host);
+                    q->state = 2;
+                    ++answered;
+                    continue;
+                }
+                dq_send(q, fds);
+                rto = DNSCHECK_RTO << (q->tries - 1);
+            }
+            if (q->sent + rto - t < timeout)
+                timeout = q->sent + rto - t;
+            ++inflight;
+        }
+        if (answered >= n)
+            break;
+
+        for (i = 0; i < 2; ++i) {
+            if (fds[i] == -1)
+                continue;
+            pfd[np].fd = fds[i];
+            pfd[np++].events = POLLIN;
+        }
+        if (!np)
+            break;
+        if (timeout > deadline - t)
+            timeout = deadline - t;
+        if (poll(pfd, np, timeout < 0 ? 0 : timeout) > 0) {
+            for (i = 0; i < (size_t)np; ++i)
+                if (pfd[i].revents & POLLIN)
+                    dq_reply(qs, next, pfd[i].fd);
+        }
+    }
+
+    for (i = 0; i < 2; ++i)
+        if (fds[i] != -1)
+            close(fds[i]);
+    free(qs);
+}
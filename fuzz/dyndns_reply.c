@@ -0,0 +1,108 @@
+/* dyndns_reply.c - fuzz target for the dyndns2 reply parser
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * libFuzzer entry point for dyndns_parse_reply().  The first input byte
+ * picks the chunk size, the second the number of statuses wanted, and the
+ * rest is the reply.  The result must agree with a naive classifier that
+ * splits the reply on whitespace and compares every token against each
+ * status keyword in turn.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+
+#include "dns_dyn.h"
+
+int use_ssl = 0;
+
+#define FUZZ_MAX_CODES 64
+
+static const struct {
+    const char *tok;
+    return_codes code;
+} naive_codes[] = {
+    { "badsys", RET_BADSYS },
+    { "badagent", RET_BADAGENT },
+    { "badauth", RET_BADAUTH },
+    { "!donator", RET_NOTDONATOR },
+    { "good", RET_GOOD },
+    { "nochg", RET_NOCHG },
+    { "notfqdn", RET_NOTFQDN },
+    { "nohost", RET_NOHOST },
+    { "!yours", RET_NOTYOURS },
+    { "abuse", RET_ABUSE },
+    { "numhost", RET_NUMHOST },
+    { "dnserr", RET_DNSERR },
+    { "911", RET_911 },
+};
+
+static size_t naive_parse(const char *buf, size_t len, return_codes *codes,
+                          size_t n)
+{
+    size_t i = 0, start, k, got = 0;
+
+    while (i < len && got < n) {
+        while (i < len && isspace((unsigned char)buf[i]))
+            ++i;
+        start = i;
+        while (i < len && !isspace((unsigned char)buf[i]))
+            ++i;
+        if (i == start)
+            break;
+        for (k = 0; k < sizeof naive_codes / sizeof naive_codes[0]; ++k) {
+            if (strlen(naive_codes[k].tok) == i - start &&
+                !memcmp(naive_codes[k].tok, buf + start, i - start)) {
+                codes[got++] = naive_codes[k].code;
+                break;
+            }
+        }
+    }
+    return got;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    return_codes got[FUZZ_MAX_CODES], want[FUZZ_MAX_CODES];
+    size_t chunk, n, got_n, want_n;
+
+    if (size < 2)
+        return 0;
+    chunk = 1 + data[0];
+    n = data[1] % (FUZZ_MAX_CODES + 1);
+    data += 2;
+    size -= 2;
+
+    got_n = dyndns_parse_reply((const char *)data, size, chunk, got, n);
+    want_n = naive_parse((const char *)data, size, want, n);
+    if (got_n != want_n || memcmp(got, want, got_n * sizeof *got))
+        abort();
+    return 0;
+}
@@ -0,0 +1,261 @@
+/* hostlist.c - per-provider host tables
+ *
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hostlist.h"
+#include "retry.h"
+#include "util.h"
+#include "malloc.h"
+
+#define HD_OF_SNODE(n) ((hostdata_t *)((char *)(n) - offsetof(hostdata_t, sched)))
+
+/* every list that has held a host, for hostlist_wakeup() */
+static hostlist_t *lists;
+
+hostdata_t *hostlist_find(hostlist_t *l, char *host)
+{
+    return (hostdata_t *)htab_find(&l->index, host);
+}
+
+static hostgroup_t *group_get(hostlist_t *l, struct source *src)
+{
+    hostgroup_t *g;
+
+    for (g = l->groups; g; g = g->next)
+        if (g->src == src)
+            return g;
+    g = xmalloc(sizeof (hostgroup_t));
+    memset(g, 0, sizeof *g);
+    g->src = src;
+    g->next = l->groups;
+    l->groups = g;
+    return g;
+}
+
+static void group_link(hostgroup_t *g, hostdata_t *hd)
+{
+    hd->group = g;
+    hd->gprev = NULL;
+    hd->gnext = g->head;
+    if (g->head)
+        g->head->gprev = hd;
+    g->head = hd;
+    g->scanned = 0;
+}
+
+static void group_unlink(hostdata_t *hd)
+{
+    if (hd->gprev)
+        hd->gprev->gnext = hd->gnext;
+    else
+        hd->group->head = hd->gnext;
+    if (hd->gnext)
+        hd->gnext->gprev = hd->gprev;
+    hd->gnext = hd->gprev = NULL;
+}
+
+/* Takes ownership of hd, which is grouped by hd->src; a NULL source is
+ * resolved later by hostlist_bind_default().  Returns 0 on success, or -1
+ * if a host with the same name is already present, in which case hd is
+ * left untouched. */
+int hostlist_append(hostlist_t *l, hostdata_t *hd)
+{
+    if (hostlist_find(l, hd->host))
+        return -1;
+
+    hd->node.key = hd->host;
+    htab_insert(&l->index, &hd->node);
+    hd->list = l;
+    group_link(group_get(l, hd->src), hd);
+    if (!l->linked) {
+        l->lnext = lists;
+        lists = l;
+        l->linked = 1;
+    }
+
+    hd->next = NULL;
+    hd->prev = l->tail;
+    if (l->tail)
+        l->tail->next = hd;
+    else
+        l->head = hd;
+    l->tail = hd;
+    return 0;
+}
+
+/* Unlinks and frees hd. */
+void hostlist_remove(hostlist_t *l, hostdata_t *hd)
+{
+    if (!l || !hd)
+        return;
+
+    htab_remove(&l->index, &hd->node);
+    if (hd->prev)
+        hd->prev->next = hd->next;
+    else
+        l->head = hd->next;
+    if (hd->next)
+        hd->next->prev = hd->prev;
+    else
+        l->tail = hd->prev;
+
+    retry_clear(hd);
+    group_unlink(hd);
+    free(hd->host);
+    free(hd->password);
+    free(hd->ip);
+    free(hd->ip6);
+    free(hd);
+}
+
+size_t hostlist_count(hostlist_t *l)
+{
+    return l->index.count;
+}
+
+/* Records ip as the published address of its family. */
+void hostdata_set_ip(hostdata_t *hd, char *ip)
+{
+    char **p;
+
+    if (!hd || !ip)
+        return;
+    p = ip_is_v6(ip) ? &hd->ip6 : &hd->ip;
+    addr_set(p, ip);
+}
+
+static int addr_differs(char *a, char *b)
+{
+    if (!a || !b)
+        return a != b;
+    return strcmp(a, b);
+}
+
+/* Returns the families (ADDR_V4, ADDR_V6) for which cur holds an address
+ * that hd has not yet published. */
+int hostdata_stale(hostdata_t *hd, curaddr_t *cur)
+{
+    int ret = 0;
+
+    if (cur->v4 && addr_differs(cur->v4, hd->ip))
+        ret |= ADDR_V4;
+    if (cur->v6 && addr_differs(cur->v6, hd->ip6))
+        ret |= ADDR_V6;
+    return ret;
+}
+
+/*
+ * Providers make a full pass over a group only when its source's address
+ * differs from the one the last full pass saw, or when a host failed in a
+ * way that is neither retried nor final, which asks for another pass.
+ * Otherwise they only visit the hosts whose deadlines have passed, so a
+ * quiet cycle costs O(log n) per due host rather than a walk of the whole
+ * list, and a change on one uplink only touches the hosts bound to it.
+ * Returns nonzero if a full pass is needed; the caller then makes it.
+ */
+int hostlist_need_scan(hostgroup_t *g, curaddr_t *cur)
+{
+    if (g->scanned && !addr_differs(g->ip, cur->v4) &&
+        !addr_differs(g->ip6, cur->v6))
+        return 0;
+    addr_set(&g->ip, cur->v4);
+    addr_set(&g->ip6, cur->v6);
+    g->scanned = 1;
+    return 1;
+}
+
+/* Asks for another full pass over the hosts that share hd's source. */
+void hostlist_rescan(hostdata_t *hd)
+{
+    if (hd && hd->group)
+        hd->group->scanned = 0;
+}
+
+/* Moves hd to the group of the hosts bound to src. */
+void hostlist_rebind(hostdata_t *hd, struct source *src)
+{
+    group_unlink(hd);
+    hd->src = src;
+    group_link(group_get(hd->list, src), hd);
+}
+
+/* Binds every host of l that has no source to src. */
+void hostlist_bind_default(hostlist_t *l, struct source *src)
+{
+    hostgroup_t *g, *to, **p;
+    hostdata_t *hd, *next;
+
+    for (p = &l->groups; *p && (*p)->src; p = &(*p)->next);
+    g = *p;
+    if (!g)
+        return;
+    *p = g->next;
+    to = group_get(l, src);
+    for (hd = g->head; hd; hd = next) {
+        next = hd->gnext;
+        hd->src = src;
+        group_link(to, hd);
+    }
+    free(g);
+}
+
+/* Sets the monotonic time at which hd is next due, or clears it if due is
+ * 0.  Any earlier deadline for hd is replaced. */
+void hostlist_schedule(hostdata_t *hd, time_t due)
+{
+    if (!hd || !hd->list)
+        return;
+    sched_set(&hd->list->sched, &hd->sched, due);
+}
+
+/* Removes and returns a host of l whose deadline is at or before now. */
+hostdata_t *hostlist_next_due(hostlist_t *l, time_t now)
+{
+    snode_t *n = sched_pop_due(&l->sched, now);
+
+    return n ? HD_OF_SNODE(n) : NULL;
+}
+
+/* Returns the earliest deadline of any host, or 0 if none is scheduled. */
+time_t hostlist_wakeup(void)
+{
+    time_t next = 0;
+    hostlist_t *l;
+    snode_t *n;
+
+    for (l = lists; l; l = l->lnext) {
+        n = sched_peek(&l->sched);
+        if (n && (!next || n->due < next))
+            next = n->due;
+    }
+    return next;
+}
@@ -0,0 +1,113 @@
+/* hostlist.h - per-provider host tables
+ *
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef NDYNDNS_HOSTLIST_H_
+#define NDYNDNS_HOSTLIST_H_
+
+#include <time.h>
+#include "htab.h"
+#include "sched.h"
+
+struct hostlist;
+struct hostgroup;
+struct source;
+
+/* The addresses that hosts should point at; either may be NULL when it is
+ * unknown or that family is not in use. */
+typedef struct {
+    char *v4;
+    char *v6;
+} curaddr_t;
+
+#define ADDR_V4 1
+#define ADDR_V6 2
+
+/*
+ * A hostdata_t is a stable handle: once appended to a list, it stays at
+ * the same address until it is removed, so providers may hold on to it
+ * across a transfer instead of looking the host up again by name.
+ *
+ * A host has at most one pending deadline in its list's scheduler: a retry
+ * after a temporary failure, or a periodic refresh.
+ */
+typedef struct hostdata {
+    hnode_t node;               /* keyed by host */
+    char *host;
+    char *password;
+    char *ip;
+    char *ip6;                  /* last published IPv6 address or NULL */
+    time_t date;
+    time_t retry_at;            /* monotonic; 0 if not backing off */
+    unsigned int retries;       /* consecutive temporary failures */
+    snode_t sched;
+    struct source *src;         /* where its addresses come from */
+    struct hostlist *list;
+    struct hostgroup *group;
+    struct hostdata *next;
+    struct hostdata *prev;
+    struct hostdata *gnext;     /* hosts of the same group */
+    struct hostdata *gprev;
+} hostdata_t;
+
+/* The hosts of one list that are bound to the same source. */
+typedef struct hostgroup {
+    struct source *src;         /* NULL until hostlist_bind_default() */
+    hostdata_t *head;
+    char *ip;                   /* addresses of the last full pass */
+    char *ip6;
+    int scanned;
+    struct hostgroup *next;
+} hostgroup_t;
+
+typedef struct hostlist {
+    hostdata_t *head;
+    hostdata_t *tail;
+    htab_t index;
+    sched_t sched;
+    hostgroup_t *groups;
+    struct hostlist *lnext;     /* all lists that hold hosts */
+    int linked;
+} hostlist_t;
+
+hostdata_t *hostlist_find(hostlist_t *l, char *host);
+int hostlist_append(hostlist_t *l, hostdata_t *hd);
+void hostlist_remove(hostlist_t *l, hostdata_t *hd);
+size_t hostlist_count(hostlist_t *l);
+void hostdata_set_ip(hostdata_t *hd, char *ip);
+int hostdata_stale(hostdata_t *hd, curaddr_t *cur);
+
+void hostlist_bind_default(hostlist_t *l, struct source *src);
+void hostlist_rebind(hostdata_t *hd, struct source *src);
+int hostlist_need_scan(hostgroup_t *g, curaddr_t *cur);
+void hostlist_rescan(hostdata_t *hd);
+void hostlist_schedule(hostdata_t *hd, time_t due);
+hostdata_t *hostlist_next_due(hostlist_t *l, time_t now);
+time_t hostlist_wakeup(void);
+
+#endif
@@ -0,0 +1,108 @@
+/* htab.c - intrusive string-keyed hash table
+ *
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "htab.h"
+#include "malloc.h"
+
+#define HTAB_MIN_BUCKETS 16
+
+/* FNV-1a */
+unsigned int htab_hash(char *key)
+{
+    unsigned int h = 2166136261u;
+
+    for (; *key; ++key) {
+        h ^= (unsigned char)*key;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+hnode_t *htab_find(htab_t *t, char *key)
+{
+    hnode_t *n;
+
+    if (!t->nbuckets || !key)
+        return NULL;
+    n = t->buckets[htab_hash(key) & (t->nbuckets - 1)];
+    for (; n && strcmp(n->key, key); n = n->hnext);
+    return n;
+}
+
+static void htab_grow(htab_t *t)
+{
+    size_t i, nb = t->nbuckets ? t->nbuckets * 2 : HTAB_MIN_BUCKETS;
+    hnode_t **b = xmalloc(nb * sizeof (hnode_t *)), *n, *next;
+
+    memset(b, 0, nb * sizeof (hnode_t *));
+    for (i = 0; i < t->nbuckets; ++i) {
+        for (n = t->buckets[i]; n; n = next) {
+            size_t j = htab_hash(n->key) & (nb - 1);
+            next = n->hnext;
+            n->hnext = b[j];
+            b[j] = n;
+        }
+    }
+    free(t->buckets);
+    t->buckets = b;
+    t->nbuckets = nb;
+}
+
+/* n->key must be set and must stay valid while n is in the table. */
+void htab_insert(htab_t *t, hnode_t *n)
+{
+    size_t i;
+
+    if (t->count >= t->nbuckets)
+        htab_grow(t);
+    i = htab_hash(n->key) & (t->nbuckets - 1);
+    n->hnext = t->buckets[i];
+    t->buckets[i] = n;
+    ++t->count;
+}
+
+void htab_remove(htab_t *t, hnode_t *n)
+{
+    hnode_t **p;
+
+    if (!t->nbuckets)
+        return;
+    p = &t->buckets[htab_hash(n->key) & (t->nbuckets - 1)];
+    for (; *p; p = &(*p)->hnext) {
+        if (*p == n) {
+            *p = n->hnext;
+            n->hnext = NULL;
+            --t->count;
+            return;
+        }
+    }
+}
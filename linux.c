@@ -37,6 +37,8 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 #include <errno.h>
 
 #include "defines.h"
@@ -44,14 +46,15 @@
 #include "log.h"
 #include "strl.h"
 #include "util.h"
+#include "arena.h"
 #include "malloc.h"
 
-/* allocates from heap for return */
+/* allocates from the cycle arena for return */
 char *get_interface_ip(char *ifname)
 {
     struct ifreq ifr;
     char *ip = NULL, *ret = NULL;
-    int fd, len;
+    int fd;
 
     if (ifname == NULL)
         goto out;
@@ -72,12 +75,243 @@ char *get_interface_ip(char *ifname)
     }
 
     ip = inet_ntoa(((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr);
-    len = strlen(ip) + 1;
-    ret = xmalloc(len);
-    strnkcpy(ret, ip, len);
+    ret = arena_strdup(ip);
 outfd:
     close(fd);
 out:
     return ret;
 }
 
+/* Picks the address from one RTM_NEWADDR message if it is a stable global
+ * address on interface idx.  Returns 1 and fills ip if so. */
+static int ip6_from_newaddr(struct nlmsghdr *nlh, unsigned int idx,
+                            char *ip, size_t iplen)
+{
+    struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
+    struct in6_addr *addr = NULL;
+    struct rtattr *rta;
+    unsigned int flags = ifa->ifa_flags;
+    int len;
+
+    if (nlh->nlmsg_type != RTM_NEWADDR || ifa->ifa_family != AF_INET6 ||
+        ifa->ifa_index != idx)
+        return 0;
+    len = IFA_PAYLOAD(nlh);
+    for (rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if (rta->rta_type == IFA_ADDRESS)
+            addr = RTA_DATA(rta);
+#ifdef IFA_FLAGS
+        else if (rta->rta_type == IFA_FLAGS)
+            flags = *(unsigned int *)RTA_DATA(rta);
+#endif
+    }
+    /* Privacy addresses come and go; publishing them would cause an update
+     * every time one is rotated. */
+    if (!addr || (flags & (IFA_F_TEMPORARY | IFA_F_DEPRECATED |
+                           IFA_F_TENTATIVE | IFA_F_DADFAILED)))
+        return 0;
+    if (!ip6_is_global(addr))
+        return 0;
+    return inet_ntop(AF_INET6, addr, ip, iplen) != NULL;
+}
+
+/* allocates from the cycle arena for return; the first stable global IPv6
+ * address on ifname, or NULL if it has none */
+char *get_interface_ip6(char *ifname)
+{
+    struct {
+        struct nlmsghdr nlh;
+        struct ifaddrmsg ifa;
+    } req;
+    struct sockaddr_nl nl;
+    struct nlmsghdr *nlh;
+    char buf[8192], ip[INET6_ADDRSTRLEN];
+    char *ret = NULL;
+    unsigned int idx;
+    ssize_t r;
+    int fd, done = 0;
+
+    if (ifname == NULL)
+        return NULL;
+
+    idx = if_nametoindex(ifname);
+    if (!idx) {
+        log_line("%s: (%s) no such interface", ifname, __func__);
+        return NULL;
+    }
+
+    fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    if (fd == -1) {
+        log_line("%s: (%s) failed to open netlink socket: %s",
+                 ifname, __func__, strerror(errno));
+        return NULL;
+    }
+
+    memset(&req, 0, sizeof req);
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof req.ifa);
+    req.nlh.nlmsg_type = RTM_GETADDR;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nlh.nlmsg_seq = 1;
+    req.ifa.ifa_family = AF_INET6;
+    memset(&nl, 0, sizeof nl);
+    nl.nl_family = AF_NETLINK;
+    if (sendto(fd, &req, req.nlh.nlmsg_len, 0, (struct sockaddr *)&nl,
+               sizeof nl) == -1) {
+        log_line("%s: (%s) RTM_GETADDR failed: %s",
+                 ifname, __func__, strerror(errno));
+        goto outfd;
+    }
+
+    while (!done) {
+        r = recv(fd, buf, sizeof buf, 0);
+        if (r == -1) {
+            if (errno == EINTR)
+                continue;
+            log_line("%s: (%s) netlink recv failed: %s",
+                     ifname, __func__, strerror(errno));
+            break;
+        }
+        if (r == 0)
+            break;
+        for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, (size_t)r);
+             nlh = NLMSG_NEXT(nlh, r)) {
+            if (nlh->nlmsg_type == NLMSG_DONE ||
+                nlh->nlmsg_type == NLMSG_ERROR) {
+                done = 1;
+                break;
+            }
+            if (!ret && ip6_from_newaddr(nlh, idx, ip, sizeof ip))
+                ret = arena_strdup(ip);
+        }
+    }
+    if (!ret)
+        log_line("%s: (%s) no global IPv6 address", ifname, __func__);
+outfd:
+    close(fd);
+    return ret;
+}
+
+
+/* Returns a rtnetlink socket that is subscribed to link and address
+ * change notifications, or -1 if netlink is unavailable. */
+int ifchange_open(void)
+{
+    struct sockaddr_nl nl;
+    int fd;
+
+    fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    if (fd == -1) {
+        log_line("(%s) failed to open netlink socket: %s",
+                 __func__, strerror(errno));
+        return -1;
+    }
+
+    memset(&nl, 0, sizeof nl);
+    nl.nl_family = AF_NETLINK;
+    nl.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+    if (bind(fd, (struct sockaddr *)&nl, sizeof nl) == -1) {
+        log_line("(%s) failed to bind netlink socket: %s",
+                 __func__, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Returns the entry of the NULL-terminated ifnames list that the message
+ * refers to, or NULL if none. */
+static char *ifchange_match(struct nlmsghdr *nlh, char **ifnames)
+{
+    char name[IFNAMSIZ], *colon;
+    struct rtattr *rta;
+    int len, idx, i;
+
+    name[0] = '\0';
+    switch (nlh->nlmsg_type) {
+    case RTM_NEWADDR:
+    case RTM_DELADDR: {
+        struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
+        len = IFA_PAYLOAD(nlh);
+        for (rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+            if (rta->rta_type == IFA_LABEL) {
+                strnkcpy(name, RTA_DATA(rta), sizeof name);
+                break;
+            }
+        }
+        idx = ifa->ifa_index;
+        break;
+    }
+    case RTM_NEWLINK:
+    case RTM_DELLINK: {
+        struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+        len = IFLA_PAYLOAD(nlh);
+        for (rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+            if (rta->rta_type == IFLA_IFNAME) {
+                strnkcpy(name, RTA_DATA(rta), sizeof name);
+                break;
+            }
+        }
+        idx = ifi->ifi_index;
+        break;
+    }
+    default:
+        return NULL;
+    }
+
+    /* Go by index: an address label may name an alias such as eth0:1,
+     * and IPv6 address messages carry none. */
+    for (i = 0; ifnames[i]; ++i)
+        if (idx > 0 && if_nametoindex(ifnames[i]) == (unsigned int)idx)
+            return ifnames[i];
+
+    /* The interface may be gone already; fall back to the name, less any
+     * alias suffix. */
+    colon = strchr(name, ':');
+    if (colon)
+        *colon = '\0';
+    for (i = 0; name[0] && ifnames[i]; ++i)
+        if (!strncmp(name, ifnames[i], IFNAMSIZ))
+            return ifnames[i];
+    return NULL;
+}
+
+/* Drains all pending notifications from fd.  Returns the first entry of
+ * the NULL-terminated ifnames list that any of them concerned (the first
+ * entry if some were lost), or NULL. */
+char *ifchange_read(int fd, char **ifnames)
+{
+    char buf[8192];
+    struct nlmsghdr *nlh;
+    ssize_t r;
+    char *ret = NULL, *m;
+
+    while (1) {
+        r = recv(fd, buf, sizeof buf, MSG_DONTWAIT);
+        if (r == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOBUFS) {
+                /* Overran the socket buffer; assume the worst. */
+                if (!ret)
+                    ret = ifnames[0];
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                log_line("(%s) netlink recv failed: %s",
+                         __func__, strerror(errno));
+            break;
+        }
+        if (r == 0)
+            break;
+        for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, (size_t)r);
+             nlh = NLMSG_NEXT(nlh, r)) {
+            if (nlh->nlmsg_type == NLMSG_DONE ||
+                nlh->nlmsg_type == NLMSG_ERROR)
+                break;
+            m = ifchange_match(nlh, ifnames);
+            if (m && !ret)
+                ret = m;
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,227 @@
+/* metrics.c - per-provider transfer timing metrics
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <curl/curl.h>
+
+#include "defines.h"
+#include "metrics.h"
+#include "log.h"
+#include "strl.h"
+
+/*
+ * Every finished transfer adds its cURL phase timings to a histogram
+ * keyed by provider endpoint and outcome: ok, http_error for an HTTP
+ * status of 400 or above, or error if the transfer itself failed.  If a
+ * metrics file is configured, metrics_write() rewrites it after each
+ * update cycle in the Prometheus text format, via a temporary file that is
+ * renamed into place so that a scraper never sees a partial file.  All
+ * phase times are measured from the start of the transfer, as cURL reports
+ * them.
+ */
+
+enum { OUT_OK, OUT_HTTP_ERROR, OUT_ERROR, OUT_MAX };
+enum { PH_NAMELOOKUP, PH_CONNECT, PH_APPCONNECT, PH_STARTTRANSFER, PH_TOTAL,
+       PH_MAX };
+
+static const char * const ep_names[EP_MAX] = {
+    [EP_DYNDNS] = "dyndns",
+    [EP_NAMECHEAP] = "namecheap",
+    [EP_HE_DNS] = "he_dns",
+    [EP_HE_TUN] = "he_tunnel",
+    [EP_CHECKIP] = "checkip",
+    [EP_CHECKIP6] = "checkip6",
+};
+static const char * const out_names[OUT_MAX] = {
+    "ok", "http_error", "error"
+};
+static const char * const ph_names[PH_MAX] = {
+    "namelookup", "connect", "appconnect", "starttransfer", "total"
+};
+static const CURLINFO ph_info[PH_MAX] = {
+    CURLINFO_NAMELOOKUP_TIME, CURLINFO_CONNECT_TIME,
+    CURLINFO_APPCONNECT_TIME, CURLINFO_STARTTRANSFER_TIME,
+    CURLINFO_TOTAL_TIME
+};
+
+static const double bounds[] = {
+    0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30
+};
+#define NBOUNDS (sizeof bounds / sizeof bounds[0])
+
+typedef struct {
+    unsigned long bucket[NBOUNDS + 1];  /* last one is +Inf */
+    double sum;
+} histo_t;
+
+typedef struct {
+    histo_t phase[PH_MAX];
+    unsigned long count;
+} series_t;
+
+static series_t series[EP_MAX][OUT_MAX];
+static unsigned long connects[EP_MAX];
+static char *metrics_path;
+
+void metrics_set_path(char *path)
+{
+    free(metrics_path);
+    metrics_path = strdup(path);
+}
+
+static void histo_add(histo_t *hg, double v)
+{
+    size_t i;
+
+    for (i = 0; i < NBOUNDS && v > bounds[i]; ++i);
+    ++hg->bucket[i];
+    hg->sum += v;
+}
+
+void metrics_record(endpoint_id ep, CURLcode result, CURL *h)
+{
+    series_t *s;
+    double v;
+    long conns = 0, code = 0;
+    int i, out = OUT_ERROR;
+
+    if (ep < 0 || ep >= EP_MAX)
+        return;
+    if (result == CURLE_OK) {
+        curl_easy_getinfo(h, CURLINFO_RESPONSE_CODE, &code);
+        out = code >= 400 ? OUT_HTTP_ERROR : OUT_OK;
+    }
+    s = &series[ep][out];
+    ++s->count;
+    for (i = 0; i < PH_MAX; ++i) {
+        v = 0;
+        curl_easy_getinfo(h, ph_info[i], &v);
+        histo_add(&s->phase[i], v);
+    }
+    curl_easy_getinfo(h, CURLINFO_NUM_CONNECTS, &conns);
+    connects[ep] += conns;
+}
+
+static void write_series(FILE *f, int ep, int out)
+{
+    series_t *s = &series[ep][out];
+    unsigned long cum;
+    size_t i;
+    int p;
+
+    for (p = 0; p < PH_MAX; ++p) {
+        histo_t *hg = &s->phase[p];
+        char labels[128];
+
+        snprintf(labels, sizeof labels,
+                 "provider=\"%s\",outcome=\"%s\",phase=\"%s\"",
+                 ep_names[ep], out_names[out], ph_names[p]);
+        for (i = 0, cum = 0; i < NBOUNDS; ++i) {
+            cum += hg->bucket[i];
+            fprintf(f, "ndyndns_request_duration_seconds_bucket{%s,le=\"%g\"} %lu\n",
+                    labels, bounds[i], cum);
+        }
+        fprintf(f, "ndyndns_request_duration_seconds_bucket{%s,le=\"+Inf\"} %lu\n",
+                labels, s->count);
+        fprintf(f, "ndyndns_request_duration_seconds_sum{%s} %.6f\n",
+                labels, hg->sum);
+        fprintf(f, "ndyndns_request_duration_seconds_count{%s} %lu\n",
+                labels, s->count);
+    }
+}
+
+void metrics_write(void)
+{
+    char tmp[MAX_PATH_LENGTH];
+    FILE *f;
+    int ep, out, fd;
+
+    if (!metrics_path)
+        return;
+    if (strnkcpy(tmp, metrics_path, sizeof tmp) ||
+        strnkcat(tmp, ".tmp", sizeof tmp)) {
+        log_line("%s: metrics path is too long", __func__);
+        return;
+    }
+
+    /* Readable by the exporter, whatever the daemon's umask.  No fsync:
+     * the file is rewritten every cycle and a lost copy costs nothing. */
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1 || fchmod(fd, 0644) == -1 || !(f = fdopen(fd, "w"))) {
+        log_line("%s: failed to open %s: %s", __func__, tmp, strerror(errno));
+        if (fd != -1) {
+            close(fd);
+            unlink(tmp);
+        }
+        return;
+    }
+
+    fprintf(f, "# HELP ndyndns_requests_total Update and checkip requests by provider and outcome.\n"
+            "# TYPE ndyndns_requests_total counter\n");
+    for (ep = 0; ep < EP_MAX; ++ep)
+        for (out = 0; out < OUT_MAX; ++out)
+            if (series[ep][out].count)
+                fprintf(f, "ndyndns_requests_total{provider=\"%s\",outcome=\"%s\"} %lu\n",
+                        ep_names[ep], out_names[out], series[ep][out].count);
+
+    fprintf(f, "# HELP ndyndns_connections_total New connections opened, each with a TLS handshake if https is used.\n"
+            "# TYPE ndyndns_connections_total counter\n");
+    for (ep = 0; ep < EP_MAX; ++ep)
+        if (connects[ep])
+            fprintf(f, "ndyndns_connections_total{provider=\"%s\"} %lu\n",
+                    ep_names[ep], connects[ep]);
+
+    fprintf(f, "# HELP ndyndns_request_duration_seconds Time from the start of a request to the end of each phase.\n"
+            "# TYPE ndyndns_request_duration_seconds histogram\n");
+    for (ep = 0; ep < EP_MAX; ++ep)
+        for (out = 0; out < OUT_MAX; ++out)
+            if (series[ep][out].count)
+                write_series(f, ep, out);
+
+    if (fflush(f)) {
+        log_line("%s: failed to write %s: %s", __func__, tmp, strerror(errno));
+        fclose(f);
+        unlink(tmp);
+        return;
+    }
+    if (fclose(f)) {
+        log_line("%s: failed to close %s: %s", __func__, tmp, strerror(errno));
+        unlink(tmp);
+        return;
+    }
+    if (rename(tmp, metrics_path) == -1) {
+        log_line("%s: failed to rename %s: %s", __func__, tmp, strerror(errno));
+        unlink(tmp);
+    }
+}
@@ -42,6 +42,7 @@
 #include <time.h>
 #include <pwd.h>
 #include <grp.h>
+#include <poll.h>
 
 #include <signal.h>
 #include <errno.h>
@@ -63,27 +64,43 @@
 #include "checkip.h"
 #include "util.h"
 #include "malloc.h"
-
-#include "dns_dyn.h"
-#include "dns_nc.h"
-#include "dns_he.h"
+#include "transport.h"
+#include "state.h"
+#include "metrics.h"
+#include "hostlist.h"
+#include "source.h"
+#include "dnscheck.h"
+#include "arena.h"
+#include "control.h"
+#include "provider.h"
 
 int use_ssl = 1;
 
-static char ifname[IFNAMSIZ] = "ppp0";
 static char pidfile[MAX_PATH_LENGTH] = "/var/run/ndyndns.pid";
 
-static int update_interval = 120; // seconds
-static int update_from_remote = 0;
+static int base_interval = 120; // seconds; 600 in remote mode
+static int update_interval = 120; // seconds; base_interval or shorter
+static int ifchange_fd = -1;
+static int control_fd = -1;
+static char **ifnames;          /* interfaces that sources read */
+
+/* Lists of DNS names whose published records can be checked. */
+static hostlist_t *checked_lists[PROV_MAX + 1];
+static time_t next_cycle;       /* monotonic; 0 if not yet scheduled */
 static int cfg_uid = 0, cfg_gid = 0;
 
-static volatile sig_atomic_t pending_exit;
+static volatile sig_atomic_t pending_exit, pending_reload;
 
 static void sighandler(int sig) {
     sig = sig; /* silence warning */
     pending_exit = 1;
 }
 
+static void sighup(int sig) {
+    sig = sig; /* silence warning */
+    pending_reload = 1;
+}
+
 static void fix_signals(void) {
     disable_signal(SIGPIPE);
     disable_signal(SIGUSR1);
@@ -91,60 +108,155 @@ static void fix_signals(void) {
     disable_signal(SIGTSTP);
     disable_signal(SIGTTIN);
     disable_signal(SIGCHLD);
-    disable_signal(SIGHUP);
 
     hook_signal(SIGINT, sighandler, 0);
     hook_signal(SIGTERM, sighandler, 0);
+    hook_signal(SIGHUP, sighup, 0);
 }
 
-static void do_sleep(void)
+/* Sleeps until the next address check is due, the kernel reports a change
+ * on a source's interface, a control request asks for a cycle, or the
+ * earliest host deadline (a retry or a refresh) passes, whichever comes
+ * first.  Returns 1 if woken only for a host deadline; the address check
+ * then keeps its original deadline. */
+static int do_sleep(void)
 {
-    struct timespec req = { update_interval, 0 }, rem;
-retry:
-    if (pending_exit)
-        exit(EXIT_SUCCESS);
-
-    if (nanosleep(&req, &rem)) {
-        switch (errno) {
-        case EINTR:
-            req = rem;
-            goto retry;
-        default:
-            suicide("nanosleep failed");
+    struct pollfd pfd[2] = {
+        { .fd = ifchange_fd, .events = POLLIN },
+        { .fd = control_fd, .events = POLLIN },
+    };
+    time_t now = clock_mono(), until, due;
+    int left, r, act, host_due = 0;
+    char *changed;
+
+    if (next_cycle <= now)
+        next_cycle = now + update_interval;
+    until = next_cycle;
+    due = hostlist_wakeup();
+    if (due > now && due < until) {
+        until = due;
+        host_due = 1;
+    }
+
+    while (1) {
+        if (pending_exit)
+            exit(EXIT_SUCCESS);
+        if (pending_reload) {
+            next_cycle = 0;
+            return 0;
+        }
+
+        left = until - clock_mono();
+        if (left <= 0)
+            break;
+
+        /* poll() ignores the entries whose fd is -1 */
+        pfd[0].fd = ifchange_fd;
+        r = poll(pfd, 2, left * 1000);
+        if (r == -1) {
+            if (errno == EINTR)
+                continue;
+            suicide("poll failed");
+        }
+        if (r == 0)
+            break;
+        if (pfd[1].revents & POLLIN) {
+            act = control_serve();
+            if (act & CONTROL_RELOAD)
+                pending_reload = 1;
+            if (act) {
+                next_cycle = 0;
+                return 0;
+            }
+        }
+        if (!(pfd[0].revents & POLLIN))
+            continue;
+        changed = ifchange_read(ifchange_fd, ifnames);
+        if (changed) {
+            log_line("%s changed.  Checking addresses.", changed);
+            next_cycle = 0;
+            return 0;
         }
     }
+    if (host_due)
+        return 1;
+    next_cycle = 0;
+    return 0;
 }
 
-static void do_work(void)
+/* Watches the interfaces of the sources that are in use for changes. */
+static void watch_ifaces(void)
 {
-    char *curip = NULL;
-    struct in_addr inr;
+    ifnames = source_ifnames();
+    if (ifnames[0] && ifchange_fd == -1) {
+        ifchange_fd = ifchange_open();
+        if (ifchange_fd == -1)
+            log_line("No interface change notifications.  Polling every %d seconds.", update_interval);
+    }
+}
 
-    log_line("updating to interface: [%s]", ifname);
+/* Applies the configuration file again after a SIGHUP. */
+static void do_reload(void)
+{
+    pending_reload = 0;
+    if (reload_config())
+        return;
+    providers_compile();
+    update_interval = source_poll_interval(base_interval);
+    watch_ifaces();
+}
+
+static void do_work(void)
+{
+    int due_only = 0, i, n = 0;
+    source_t *s;
+
+    for (i = 0; i < PROV_MAX; ++i)
+        if (providers[i]->verify)
+            checked_lists[n++] = providers[i]->list;
+
+    for (s = source_first(); s; s = s->next) {
+        if (!s->used)
+            continue;
+        switch (s->kind) {
+        case SRC_INTERFACE:
+            log_line("source [%s]: updating to interface: [%s]", s->name,
+                     s->ifname);
+            break;
+        case SRC_REMOTE:
+            log_line("source [%s]: updating to remote address", s->name);
+            break;
+        case SRC_STATIC:
+            log_line("source [%s]: updating to static address", s->name);
+            break;
+        case SRC_STUN:
+            log_line("source [%s]: updating to STUN mapped address", s->name);
+            break;
+        }
+    }
+    update_interval = source_poll_interval(base_interval);
+    watch_ifaces();
 
     while (1) {
-        free(curip);
+        if (pending_reload)
+            do_reload();
 
-        if (update_from_remote == 0) {
-            curip = get_interface_ip(ifname);
-        } else {
-            curip = query_curip();
-        }
+        /* Host deadlines reuse the last addresses; in remote mode checkip
+         * may not be queried again so soon. */
+        if (!due_only || !source_have_addr())
+            source_refresh();
 
-        if (!curip)
-            goto sleep;
-        if (inet_aton(curip, &inr) == 0) {
-            log_line("%s has ip: [%s], which is invalid.  Sleeping.",
-                     ifname, curip);
+        if (!source_have_addr())
             goto sleep;
-        }
 
-        dd_work(curip);
-        nc_work(curip);
-        he_dns_work(curip);
-        he_tun_work(curip);
+        dnscheck_run(checked_lists);
+        providers_work();
+        transport_run();
+        state_commit();
+        metrics_write();
 sleep:
-        do_sleep();
+        arena_reset();
+        due_only = do_sleep();
     }
 }
 
@@ -166,8 +278,13 @@ static int check_ssl(void)
 
 void cfg_set_remote(void)
 {
-    update_from_remote = 1;
-    update_interval = 600;
+    source_default()->kind = SRC_REMOTE;
+    base_interval = 600;
+}
+
+void cfg_set_ipv6(void)
+{
+    source_default()->ipv6 = 1;
 }
 
 void cfg_set_detach(void)
@@ -228,7 +345,7 @@ void cfg_set_group(char *groupname)
 
 void cfg_set_interface(char *interface)
 {
-    strnkcpy(ifname, interface, sizeof ifname);
+    strnkcpy(source_default()->ifname, interface, IFNAMSIZ);
 }
 
 int main(int argc, char** argv)
@@ -252,12 +369,13 @@ int main(int argc, char** argv)
             {"group", 1, 0, 'g'},
             {"interface", 1, 0, 'i'},
             {"remote", 0, 0, 'r'},
+            {"ipv6", 0, 0, '6'},
             {"help", 0, 0, 'h'},
             {"version", 0, 0, 'v'},
             {0, 0, 0, 0}
         };
 
-        c = getopt_long(argc, argv, "rdnp:qc:xf:Fu:g:i:hv", long_options, &option_index);
+        c = getopt_long(argc, argv, "r6dnp:qc:xf:Fu:g:i:hv", long_options, &option_index);
         if (c == -1) break;
 
         switch (c) {
@@ -279,6 +397,7 @@ int main(int argc, char** argv)
 "  -g, --group                 group name that ndyndns should run as\n"
 "  -i, --interface             interface ip to check (default: ppp0)\n"
 "  -r, --remote                get ip from remote dyndns host (overrides -i)\n"
+"  -6, --ipv6                  also detect and publish an IPv6 address\n"
 "  -h, --help                  print this help and exit\n"
 "  -v, --version               print version and license info and exit\n"
                 );
@@ -314,6 +433,10 @@ int main(int argc, char** argv)
                 cfg_set_remote();
                 break;
 
+            case '6':
+                cfg_set_ipv6();
+                break;
+
             case 'd':
                 cfg_set_detach();
                 break;
@@ -400,6 +523,9 @@ int main(int argc, char** argv)
     if (!chroot_exists())
         suicide("FATAL - No chroot path specified.  Refusing to run.");
 
+    if (chroot_enabled())
+        cfg_enter_chroot(get_chroot());
+
     /* Note that failure cases are handled by called fns. */
     imprison(get_chroot());
     drop_root(cfg_uid, cfg_gid);
@@ -407,9 +533,11 @@ int main(int argc, char** argv)
     /* Cover our tracks... */
     wipe_chroot();
     memset(pidfile, '\0', sizeof pidfile);
+    control_fd = control_open();
 
     curl_global_init(CURL_GLOBAL_ALL);
     use_ssl = check_ssl();
+    providers_compile();
 
     do_work();
 
@@ -0,0 +1,188 @@
+/* provider.c - registry of dynamic dns update providers
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "provider.h"
+#include "dns_helpers.h"
+#include "retry.h"
+#include "source.h"
+#include "arena.h"
+#include "log.h"
+#include "util.h"
+
+#include "dns_dyn.h"
+#include "dns_nc.h"
+#include "dns_he.h"
+
+provider_t * const providers[PROV_MAX] = {
+    [PROV_DYNDNS] = &dd_provider,
+    [PROV_NAMECHEAP] = &nc_provider,
+    [PROV_HE] = &he_provider,
+    [PROV_HE_TUNNEL] = &he_tun_provider,
+};
+
+void providers_init(void)
+{
+    int i;
+
+    for (i = 0; i < PROV_MAX; ++i)
+        providers[i]->init(providers[i]->conf);
+}
+
+void providers_compile(void)
+{
+    int i;
+
+    for (i = 0; i < PROV_MAX; ++i)
+        providers[i]->compile();
+}
+
+/* Records that ip was published for hd. */
+void provider_updated(hostdata_t *hd, char *ip)
+{
+    write_dnsip(hd->host, ip);
+    write_dnsdate(hd->host, clock_time());
+    hd->date = clock_time();
+    retry_clear(hd);
+    hostdata_set_ip(hd, ip);
+}
+
+/* The update of hd failed in a way that is neither retried nor final. */
+void provider_failed(hostdata_t *hd)
+{
+    log_line("%s: [fail] - Failed to update.", hd->host);
+    hostlist_rescan(hd);
+}
+
+/* per-request context of build() requests; it lives in the cycle arena */
+typedef struct {
+    provider_t *p;
+    hostdata_t *hd;
+    char *ip;
+} provider_req_t;
+
+static void provider_done(int ret, resp_t *resp, void *arg)
+{
+    provider_req_t *r = arg;
+
+    if (ret == 1)
+        retry_defer(r->hd, resp->retry_after);
+    if (ret)
+        return;
+    log_line("response returned: [%s]", resp->head);
+    if (r->p->apply) {
+        r->p->apply(r->hd, r->ip, resp);
+    } else if (resp->match == 0) {
+        log_line("%s: [good] - Update successful.", r->hd->host);
+        provider_updated(r->hd, r->ip);
+    } else {
+        provider_failed(r->hd);
+    }
+}
+
+static void provider_send(provider_t *p, hostdata_t *hd, char *ip)
+{
+    provider_req_t *r;
+    char *url;
+
+    url = p->build(hd, ip);
+    if (!url)
+        return;
+    r = arena_alloc(sizeof (provider_req_t));
+    r->p = p;
+    r->hd = hd;
+    r->ip = arena_strdup(ip);
+    dyndns_curl_queue(p->ep, url, NULL, p->reply_keys, NULL, provider_done,
+                      r);
+}
+
+static void provider_check(provider_t *p, hostdata_t *hd, time_t now,
+                           time_t wall)
+{
+    curaddr_t *cur = &hd->src->cur;
+    int send;
+
+    if (retry_pending(hd, now))
+        return;
+    if (p->plan)
+        send = p->plan(hd, now, wall);
+    else
+        send = hostdata_stale(hd, cur) & p->families;
+    if (!send) {
+        if (hd->retries)
+            retry_clear(hd);
+        return;
+    }
+
+    log_line("adding for %s [%s]", send == PLAN_REFRESH ? "refresh" :
+             "update", hd->host);
+    hostlist_schedule(hd, 0);
+    if (p->queue) {
+        p->queue(hd);
+        return;
+    }
+    if (send == PLAN_REFRESH)
+        send = p->families;
+    if ((send & ADDR_V4) && cur->v4)
+        provider_send(p, hd, cur->v4);
+    if ((send & ADDR_V6) && cur->v6)
+        provider_send(p, hd, cur->v6);
+}
+
+static void provider_work(provider_t *p, time_t now, time_t wall)
+{
+    hostgroup_t *g;
+    hostdata_t *hd;
+
+    for (g = p->list->groups; g; g = g->next) {
+        curaddr_t cur = {
+            p->families & ADDR_V4 ? g->src->cur.v4 : NULL,
+            p->families & ADDR_V6 ? g->src->cur.v6 : NULL,
+        };
+        if ((cur.v4 || cur.v6) && hostlist_need_scan(g, &cur))
+            for (hd = g->head; hd; hd = hd->gnext)
+                provider_check(p, hd, now, wall);
+    }
+    while ((hd = hostlist_next_due(p->list, now)))
+        provider_check(p, hd, now, wall);
+    if (p->flush)
+        p->flush();
+}
+
+/* Plans and queues the updates of every provider; transport_run() then
+ * sends them. */
+void providers_work(void)
+{
+    time_t now = clock_mono(), wall = clock_time();
+    int i;
+
+    for (i = 0; i < PROV_MAX; ++i)
+        provider_work(providers[i], now, wall);
+}
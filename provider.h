@@ -0,0 +1,120 @@
+/* provider.h - registry of dynamic dns update providers
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef NDYNDNS_PROVIDER_H_
+#define NDYNDNS_PROVIDER_H_
+
+#include <stddef.h>
+#include <time.h>
+#include "cfg.h"
+#include "hostlist.h"
+#include "transport.h"
+#include "response.h"
+
+/* How a statement of a provider's section is taken. */
+enum {
+    PK_STRING,                  /* value is copied to the char * at off */
+    PK_FLAG,                    /* flag is stored in the int or enum at off */
+    PK_HOSTS,                   /* an entry of the provider's host list */
+    PK_HOSTPAIRS,               /* a host:password entry of it */
+};
+
+typedef struct {
+    unsigned int key;           /* K_ statement; K_MAX ends the table */
+    unsigned char type;
+    size_t off;                 /* of the field in the provider's conf */
+    int flag;
+} provider_key_t;
+
+#define PK_END { K_MAX, 0, 0, 0 }
+
+/* Returned by plan() for a host that is to be sent again although its
+ * addresses have not changed. */
+#define PLAN_REFRESH 4
+
+/*
+ * A provider keeps one list of hosts up to date with one kind of request.
+ * The scheduling is common to all of them: provider_work() visits the
+ * hosts whose source changed or whose deadline passed, asks plan() which
+ * of their addresses to send, and either collects them with queue() for
+ * flush() to batch, or sends one request per address, built by build(),
+ * whose reply is matched against reply_keys and handed to apply().  The
+ * requests are queued on the transport, which runs them concurrently.
+ */
+typedef struct provider {
+    const char *name;           /* as named in update requests */
+    const char *label;          /* as reported in state replies and logs */
+    unsigned int section;       /* K_ header of its configuration section */
+    endpoint_id ep;
+    hostlist_t *list;
+    int families;               /* ADDR_ flags of the addresses it sends */
+    int verify;                 /* hosts are names that dnscheck can ask */
+    void *conf;                 /* the running configuration */
+    size_t conf_size;
+    const provider_key_t *keys; /* statements of its section */
+    const char * const *reply_keys;
+
+    /* sets a configuration to the defaults */
+    void (*init)(void *conf);
+    /* may be NULL; returns 1 if conf is usable, hosts is nonzero if the
+     * list has any */
+    int (*validate)(void *conf, int hosts);
+    /* builds the parts of requests that depend only on the configuration */
+    void (*compile)(void);
+    /* may be NULL to send the families in which the host is stale;
+     * returns ADDR_ flags or PLAN_REFRESH.  A host that is not sent has
+     * its retries cleared, which cancels its deadline, so plan() must
+     * clear them itself before setting a new one. */
+    int (*plan)(hostdata_t *hd, time_t now, time_t wall);
+    /* may be NULL if queue() is set; returns the URL that sends ip for hd,
+     * valid until the next call, or NULL if none can be sent */
+    char *(*build)(hostdata_t *hd, char *ip);
+    /* may be NULL to treat the first reply key as success */
+    void (*apply)(hostdata_t *hd, char *ip, resp_t *resp);
+    /* may be NULL; collects hosts to update for flush() */
+    void (*queue)(hostdata_t *hd);
+    void (*flush)(void);
+} provider_t;
+
+typedef enum {
+    PROV_DYNDNS,
+    PROV_NAMECHEAP,
+    PROV_HE,
+    PROV_HE_TUNNEL,
+    PROV_MAX
+} provider_id;
+
+extern provider_t * const providers[PROV_MAX];
+
+void providers_init(void);
+void providers_compile(void);
+void providers_work(void);
+void provider_updated(hostdata_t *hd, char *ip);
+void provider_failed(hostdata_t *hd);
+
+#endif
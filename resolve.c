@@ -0,0 +1,180 @@
+/* resolve.c - batched asynchronous host resolution
+ *
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "config.h"
+#include "defines.h"
+#include "resolve.h"
+#include "util.h"
+#include "log.h"
+#include "malloc.h"
+
+static const struct addrinfo hints = {
+    .ai_family = AF_INET,
+    .ai_socktype = SOCK_STREAM,
+};
+
+static void resolve_result(resolve_req_t *r, int err, struct addrinfo *ai)
+{
+    char buf[INET_ADDRSTRLEN];
+
+    if (err) {
+        log_line("failed to resolve %s: %s.", r->name, gai_strerror(err));
+        return;
+    }
+    if (!ai || !inet_ntop(AF_INET,
+                          &((struct sockaddr_in *)ai->ai_addr)->sin_addr,
+                          buf, sizeof buf)) {
+        log_line("failed to resolve %s: no IP for host.", r->name);
+        return;
+    }
+    log_line("%s: %s returned [%s]", __func__, r->name, buf);
+    r->ip = strdup(buf);
+}
+
+#ifdef HAVE_GETADDRINFO_A
+
+typedef struct {
+    struct gaicb cb;
+    resolve_req_t *req;
+    time_t deadline;
+} lookup_t;
+
+static int start_lookup(lookup_t *l, resolve_req_t *r)
+{
+    struct gaicb *list[1];
+    int err;
+
+    memset(l, 0, sizeof *l);
+    l->cb.ar_name = strdup(r->name);
+    l->cb.ar_request = &hints;
+    l->req = r;
+    l->deadline = clock_mono() + RESOLVE_TIMEOUT;
+    list[0] = &l->cb;
+    err = getaddrinfo_a(GAI_NOWAIT, list, 1, NULL);
+    if (err) {
+        resolve_result(r, err, NULL);
+        free((char *)l->cb.ar_name);
+    }
+    return err;
+}
+
+/* Resolves every request with at most RESOLVE_MAX_INFLIGHT lookups
+ * outstanding; each lookup is abandoned after RESOLVE_TIMEOUT seconds. */
+void resolve_hosts(resolve_req_t *reqs, size_t n)
+{
+    lookup_t *active[RESOLVE_MAX_INFLIGHT];
+    const struct gaicb *wait[RESOLVE_MAX_INFLIGHT];
+    size_t next = 0, nactive = 0, i;
+    time_t now, first;
+    struct timespec ts;
+    lookup_t *l;
+    int err;
+
+    for (;;) {
+        while (nactive < RESOLVE_MAX_INFLIGHT && next < n) {
+            l = xmalloc(sizeof *l);
+            if (start_lookup(l, &reqs[next++])) {
+                free(l);
+                continue;
+            }
+            active[nactive++] = l;
+        }
+        if (!nactive)
+            break;
+
+        now = clock_mono();
+        first = active[0]->deadline;
+        for (i = 0; i < nactive; ++i) {
+            wait[i] = &active[i]->cb;
+            if (active[i]->deadline < first)
+                first = active[i]->deadline;
+        }
+        ts.tv_sec = first > now ? first - now : 0;
+        ts.tv_nsec = 0;
+        gai_suspend(wait, nactive, &ts);
+
+        now = clock_mono();
+        for (i = 0; i < nactive;) {
+            l = active[i];
+            err = gai_error(&l->cb);
+            if (err == EAI_INPROGRESS) {
+                if (now < l->deadline) {
+                    ++i;
+                    continue;
+                }
+                err = gai_cancel(&l->cb);
+                if (err != EAI_ALLDONE) {
+                    log_line("failed to resolve %s: timed out.", l->req->name);
+                    active[i] = active[--nactive];
+                    /* A lookup that is already running cannot be cancelled
+                     * and will still write to its control block, so leak. */
+                    if (err == EAI_NOTCANCELED)
+                        continue;
+                    free((char *)l->cb.ar_name);
+                    free(l);
+                    continue;
+                }
+                err = gai_error(&l->cb);
+            }
+            resolve_result(l->req, err, l->cb.ar_result);
+            if (l->cb.ar_result)
+                freeaddrinfo(l->cb.ar_result);
+            free((char *)l->cb.ar_name);
+            free(l);
+            active[i] = active[--nactive];
+        }
+    }
+}
+
+#else
+
+void resolve_hosts(resolve_req_t *reqs, size_t n)
+{
+    struct addrinfo *ai;
+    size_t i;
+    int err;
+
+    for (i = 0; i < n; ++i) {
+        ai = NULL;
+        err = getaddrinfo(reqs[i].name, NULL, &hints, &ai);
+        resolve_result(&reqs[i], err, ai);
+        if (ai)
+            freeaddrinfo(ai);
+    }
+}
+
+#endif
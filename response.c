@@ -0,0 +1,162 @@
+/* response.c - incremental parsing of provider responses
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+
+#include "defines.h"
+#include "response.h"
+#include "log.h"
+
+/*
+ * Response bodies are parsed in place as cURL hands them over rather than
+ * being collected into a buffer first.  Each request supplies either a
+ * list of keywords, the first of which to appear decides the result, or
+ * its own feed function.  Once the result is decided the rest of the body
+ * is skipped unparsed, and a body that grows past RESP_MAX_BODY is cut
+ * off.  Short bodies are still read to their end so that the connection
+ * can be reused for the next request.
+ */
+
+void resp_init(resp_t *r, const char * const *keys, resp_feed_fn feed,
+               void *arg)
+{
+    int i;
+
+    memset(r, 0, sizeof *r);
+    r->keys = keys;
+    r->feed = feed;
+    r->arg = arg;
+    r->match = -1;
+    for (i = 0; keys && keys[i]; ++i)
+        if (strlen(keys[i]) >= RESP_KEY_LEN)
+            suicide("%s: keyword '%s' is too long", __func__, keys[i]);
+}
+
+/* Looks for the keys in the body seen so far.  Returns the index of the
+ * key that ends first, and sets *end to the offset in buf just past it;
+ * returns -1 if none has appeared.  A key split across two chunks is
+ * found by searching the tail of the previous chunk together with the
+ * start of this one. */
+int resp_keys_scan(resp_t *r, const char *buf, size_t len, size_t *end)
+{
+    char win[2 * RESP_KEY_LEN];
+    size_t n, wlen, klen, e, best_end = 0;
+    const char *p;
+    int i, best = -1;
+
+    if (!r->keys)
+        return -1;
+
+    n = len < RESP_KEY_LEN - 1 ? len : RESP_KEY_LEN - 1;
+    memcpy(win, r->carry, r->carrylen);
+    memcpy(win + r->carrylen, buf, n);
+    wlen = r->carrylen + n;
+
+    for (i = 0; r->keys[i]; ++i) {
+        klen = strlen(r->keys[i]);
+        p = memmem(win, wlen, r->keys[i], klen);
+        if (p && (size_t)(p - win) + klen > r->carrylen) {
+            e = (size_t)(p - win) + klen - r->carrylen;
+            if (best < 0 || e < best_end) {
+                best = i;
+                best_end = e;
+            }
+        }
+        p = memmem(buf, len, r->keys[i], klen);
+        if (p) {
+            e = (size_t)(p - buf) + klen;
+            if (best < 0 || e < best_end) {
+                best = i;
+                best_end = e;
+            }
+        }
+    }
+    if (best >= 0) {
+        r->match = best;
+        if (end)
+            *end = best_end;
+        return best;
+    }
+
+    if (len >= RESP_KEY_LEN - 1) {
+        r->carrylen = RESP_KEY_LEN - 1;
+        memcpy(r->carry, buf + len - r->carrylen, r->carrylen);
+    } else {
+        r->carrylen = wlen < RESP_KEY_LEN - 1 ? wlen : RESP_KEY_LEN - 1;
+        memmove(r->carry, win + wlen - r->carrylen, r->carrylen);
+    }
+    return -1;
+}
+
+static int resp_feed(resp_t *r, const char *buf, size_t len)
+{
+    if (r->feed)
+        return r->feed(r, buf, len);
+    return resp_keys_scan(r, buf, len, NULL) >= 0 ? RESP_DONE : RESP_MORE;
+}
+
+size_t resp_write(char *buf, size_t size, size_t nmemb, void *dat)
+{
+    resp_t *r = dat;
+    size_t len = size * nmemb, n;
+
+    n = len;
+    if (r->seen + n > RESP_MAX_BODY)
+        n = RESP_MAX_BODY - r->seen;
+
+    if (r->headlen < RESP_HEAD_LEN - 1) {
+        size_t h = RESP_HEAD_LEN - 1 - r->headlen;
+        if (h > n)
+            h = n;
+        memcpy(r->head + r->headlen, buf, h);
+        r->headlen += h;
+        r->head[r->headlen] = '\0';
+    }
+
+    r->seen += n;
+    if (!r->done && resp_feed(r, buf, n) == RESP_DONE)
+        r->done = 1;
+
+    if (n < len) {
+        log_line("response is longer than %d bytes; closing transfer",
+                 RESP_MAX_BODY);
+        r->stopped = 1;
+        return 0;
+    }
+    return len;
+}
+
+/* Called once the transfer has ended.  Returns nonzero if the transfer
+ * was cut short here rather than having failed. */
+int resp_finish(resp_t *r)
+{
+    if (!r->done && resp_feed(r, "", 0) == RESP_DONE)
+        r->done = 1;
+    return r->stopped;
+}
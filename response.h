@@ -0,0 +1,68 @@
+/* response.h - incremental parsing of provider responses
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef NDYNDNS_RESPONSE_H_
+#define NDYNDNS_RESPONSE_H_
+
+#include <stddef.h>
+
+#define RESP_MORE 0
+#define RESP_DONE 1
+
+#define RESP_HEAD_LEN 128       /* start of body kept for logging */
+#define RESP_KEY_LEN 80         /* longest keyword resp_keys_scan() accepts */
+
+typedef struct resp resp_t;
+
+/* Called with each chunk of the body as it arrives, and once with len == 0
+ * when the body ends.  Returns RESP_DONE once the result is decided. */
+typedef int (*resp_feed_fn)(resp_t *r, const char *buf, size_t len);
+
+struct resp {
+    resp_feed_fn feed;          /* may be NULL to match keys only */
+    void *arg;                  /* parser-private */
+    const char * const *keys;   /* NULL-terminated; may be NULL */
+    int match;                  /* index into keys, or -1 */
+    int done;                   /* parser has decided */
+    int stopped;                /* transfer was cut short */
+    size_t seen;
+    char carry[RESP_KEY_LEN];   /* tail of the previous chunk */
+    size_t carrylen;
+    char head[RESP_HEAD_LEN];
+    size_t headlen;
+    long status;                /* HTTP status, or 0 */
+    long retry_after;           /* seconds from Retry-After, or 0 */
+};
+
+void resp_init(resp_t *r, const char * const *keys, resp_feed_fn feed,
+               void *arg);
+size_t resp_write(char *buf, size_t size, size_t nmemb, void *dat);
+int resp_finish(resp_t *r);
+int resp_keys_scan(resp_t *r, const char *buf, size_t len, size_t *end);
+
+#endif
@@ -0,0 +1,85 @@
+/* retry.c - per-host retry backoff after temporary update failures
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "defines.h"
+#include "retry.h"
+#include "util.h"
+#include "log.h"
+
+/*
+ * A host whose update fails with a temporary error is scheduled for a
+ * retry on the monotonic clock.  The delay doubles with each consecutive
+ * failure, from RETRY_BASE up to RETRY_CAP seconds, and is randomized over
+ * its upper half so that many hosts do not retry in lockstep.  A longer
+ * Retry-After from the server is honoured.  Until the deadline passes, the
+ * providers skip the host, even on a regular update cycle, so a provider
+ * that is down is not hammered.  The main loop wakes at the deadline to
+ * send the due hosts again.
+ */
+static int seeded;
+
+void retry_defer(hostdata_t *hd, long retry_after)
+{
+    long delay = RETRY_BASE;
+    unsigned int i;
+
+    if (!seeded) {
+        srandom((unsigned int)(clock_mono() ^ getpid()));
+        seeded = 1;
+    }
+
+    for (i = 0; i < hd->retries && delay < RETRY_CAP; ++i)
+        delay *= 2;
+    if (delay > RETRY_CAP)
+        delay = RETRY_CAP;
+    delay = delay / 2 + random() % (delay / 2 + 1);
+    if (retry_after > delay)
+        delay = retry_after;
+
+    ++hd->retries;
+    hd->retry_at = clock_mono() + delay;
+    hostlist_schedule(hd, hd->retry_at);
+    log_line("[%s] will be retried in %ld seconds.", hd->host, delay);
+}
+
+/* Forgets any backoff for hd, along with whatever deadline it had. */
+void retry_clear(hostdata_t *hd)
+{
+    hd->retries = 0;
+    hd->retry_at = 0;
+    hostlist_schedule(hd, 0);
+}
+
+/* Returns nonzero if hd is still backing off at monotonic time now. */
+int retry_pending(hostdata_t *hd, time_t now)
+{
+    return hd->retry_at > now;
+}
@@ -0,0 +1,148 @@
+/* sched.c - min-heap of deadlines on the monotonic clock
+ *
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sched.h"
+#include "malloc.h"
+
+#define SCHED_MIN_SIZE 16
+
+/*
+ * A binary min-heap ordered by due time.  Each node records its own slot,
+ * so a queued node can be moved or removed in O(log n) without a search.
+ */
+
+static void sched_place(sched_t *s, snode_t *n, size_t i)
+{
+    s->heap[i] = n;
+    n->slot = i + 1;
+}
+
+static void sched_up(sched_t *s, size_t i)
+{
+    snode_t *n = s->heap[i];
+
+    while (i > 0) {
+        size_t p = (i - 1) / 2;
+        if (s->heap[p]->due <= n->due)
+            break;
+        sched_place(s, s->heap[p], i);
+        i = p;
+    }
+    sched_place(s, n, i);
+}
+
+static void sched_down(sched_t *s, size_t i)
+{
+    snode_t *n = s->heap[i];
+
+    while (1) {
+        size_t c = 2 * i + 1;
+        if (c >= s->len)
+            break;
+        if (c + 1 < s->len && s->heap[c + 1]->due < s->heap[c]->due)
+            ++c;
+        if (n->due <= s->heap[c]->due)
+            break;
+        sched_place(s, s->heap[c], i);
+        i = c;
+    }
+    sched_place(s, n, i);
+}
+
+/* Queues n to fall due at monotonic time due, or moves it there if it is
+ * already queued.  A due time of 0 removes it. */
+void sched_set(sched_t *s, snode_t *n, time_t due)
+{
+    if (!due) {
+        sched_cancel(s, n);
+        return;
+    }
+    if (n->slot) {
+        time_t old = n->due;
+        n->due = due;
+        if (due < old)
+            sched_up(s, n->slot - 1);
+        else
+            sched_down(s, n->slot - 1);
+        return;
+    }
+
+    if (s->len == s->size) {
+        snode_t **h;
+        s->size = s->size ? s->size * 2 : SCHED_MIN_SIZE;
+        h = xmalloc(s->size * sizeof (snode_t *));
+        if (s->len)
+            memcpy(h, s->heap, s->len * sizeof (snode_t *));
+        free(s->heap);
+        s->heap = h;
+    }
+    n->due = due;
+    s->heap[s->len++] = n;
+    sched_up(s, s->len - 1);
+}
+
+void sched_cancel(sched_t *s, snode_t *n)
+{
+    size_t i;
+    snode_t *last;
+
+    if (!n->slot)
+        return;
+    i = n->slot - 1;
+    n->slot = 0;
+    n->due = 0;
+    last = s->heap[--s->len];
+    if (i == s->len)
+        return;
+    sched_place(s, last, i);
+    if (i > 0 && s->heap[(i - 1) / 2]->due > last->due)
+        sched_up(s, i);
+    else
+        sched_down(s, i);
+}
+
+/* Returns the node that falls due first, or NULL if none is queued. */
+snode_t *sched_peek(sched_t *s)
+{
+    return s->len ? s->heap[0] : NULL;
+}
+
+/* Removes and returns a node due at or before now, or NULL if none is. */
+snode_t *sched_pop_due(sched_t *s, time_t now)
+{
+    snode_t *n = sched_peek(s);
+
+    if (!n || n->due > now)
+        return NULL;
+    sched_cancel(s, n);
+    return n;
+}
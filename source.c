@@ -0,0 +1,237 @@
+/* source.c - named address sources that hosts are bound to
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "defines.h"
+#include "source.h"
+#include "checkip.h"
+#include "stun.h"
+#include "linux.h"
+#include "util.h"
+#include "log.h"
+#include "strl.h"
+#include "malloc.h"
+
+/*
+ * Each host is bound to an address source: the default one is built from
+ * the command line and [config], and [source NAME] sections add more, so
+ * that one daemon can serve several uplinks.  Every source is refreshed
+ * on each cycle, and the providers make a full pass only over the hosts
+ * bound to a source whose address changed.
+ */
+static source_t default_src = {
+    .name = "default",
+    .kind = SRC_INTERFACE,
+    .defined = 1,
+    .ifname = "ppp0",
+};
+static source_t *sources = &default_src;
+
+source_t *source_default(void)
+{
+    return &default_src;
+}
+
+/* Returns the source called name, creating an undefined one if needed. */
+source_t *source_get(char *name)
+{
+    source_t *s, **p;
+
+    for (p = &sources; *p; p = &(*p)->next)
+        if (!strcmp((*p)->name, name))
+            return *p;
+
+    s = xmalloc(sizeof (source_t));
+    memset(s, 0, sizeof *s);
+    s->name = strdup(name);
+    s->kind = SRC_INTERFACE;
+    *p = s;
+    return s;
+}
+
+source_t *source_first(void)
+{
+    return sources;
+}
+
+/* Returns 0 if s is fully defined, or logs the problem and returns -1. */
+int source_check(source_t *s)
+{
+    if (!s->defined) {
+        log_line("source [%s] is used but not defined.", s->name);
+        return -1;
+    }
+    if ((s->kind == SRC_INTERFACE || s->bind) && !s->ifname[0]) {
+        log_line("source [%s] has no interface.", s->name);
+        return -1;
+    }
+    if (s->kind == SRC_STATIC && !s->addr4 && !s->addr6) {
+        log_line("source [%s] has no address.", s->name);
+        return -1;
+    }
+    if (s->kind == SRC_STUN && !stun_have_servers()) {
+        log_line("source [%s] uses STUN, but no stunserver is configured.",
+                 s->name);
+        return -1;
+    }
+    return 0;
+}
+
+void source_validate(void)
+{
+    source_t *s;
+
+    for (s = sources; s; s = s->next)
+        if (s->used && source_check(s))
+            suicide("FATAL - bad source [%s].", s->name);
+}
+
+/* Replaces *dst with ip if it is a valid address of family af.  The
+ * lookups return addresses in the cycle arena; *dst keeps its own copy. */
+static void set_addr(source_t *s, char **dst, char *ip, int af)
+{
+    unsigned char buf[sizeof (struct in6_addr)];
+
+    if (ip && inet_pton(af, ip, buf) != 1) {
+        log_line("[%s] has ip: [%s], which is invalid.  Ignoring it.",
+                 s->name, ip);
+        ip = NULL;
+    }
+    addr_set(dst, ip);
+}
+
+static void refresh_one(source_t *s)
+{
+    char *iface = s->bind ? s->ifname : NULL;
+    char *ip;
+    time_t now;
+
+    switch (s->kind) {
+    case SRC_INTERFACE:
+        set_addr(s, &s->cur.v4, get_interface_ip(s->ifname), AF_INET);
+        if (s->ipv6)
+            set_addr(s, &s->cur.v6, get_interface_ip6(s->ifname), AF_INET6);
+        break;
+    case SRC_REMOTE:
+        /* Query no more than once every CHECKIP_INTERVAL seconds, or
+         * CHECKIP_RETRY seconds after a failed query.  Until then, or if
+         * the query fails, the last address stands. */
+        now = clock_time();
+        if (now - s->last_query >= CHECKIP_INTERVAL) {
+            ip = query_curip(iface);
+            s->last_query = now;
+            if (ip)
+                set_addr(s, &s->cur.v4, ip, AF_INET);
+            else
+                s->last_query -= CHECKIP_INTERVAL - CHECKIP_RETRY;
+        }
+        if (s->ipv6 && now - s->last_query6 >= CHECKIP_INTERVAL) {
+            ip = query_curip6(iface);
+            s->last_query6 = now;
+            if (ip)
+                set_addr(s, &s->cur.v6, ip, AF_INET6);
+            else
+                s->last_query6 -= CHECKIP_INTERVAL - CHECKIP_RETRY;
+        }
+        break;
+    case SRC_STUN:
+        /* Cheap enough to ask every cycle; a failure keeps the last
+         * address, as for SRC_REMOTE. */
+        ip = stun_query(AF_INET, iface);
+        if (ip)
+            set_addr(s, &s->cur.v4, ip, AF_INET);
+        if (s->ipv6) {
+            ip = stun_query(AF_INET6, iface);
+            if (ip)
+                set_addr(s, &s->cur.v6, ip, AF_INET6);
+        }
+        break;
+    case SRC_STATIC:
+        set_addr(s, &s->cur.v4, s->addr4, AF_INET);
+        set_addr(s, &s->cur.v6, s->addr6, AF_INET6);
+        break;
+    }
+}
+
+/* Fetches the current addresses of every source that has hosts. */
+void source_refresh(void)
+{
+    source_t *s;
+
+    for (s = sources; s; s = s->next)
+        if (s->used)
+            refresh_one(s);
+}
+
+/* Returns nonzero if any source in use has an address. */
+int source_have_addr(void)
+{
+    source_t *s;
+
+    for (s = sources; s; s = s->next)
+        if (s->used && (s->cur.v4 || s->cur.v6))
+            return 1;
+    return 0;
+}
+
+/* Returns the NULL-terminated list of interfaces that sources in use read
+ * their addresses from. */
+char **source_ifnames(void)
+{
+    static char **names;
+    size_t n = 0;
+    source_t *s;
+
+    free(names);
+    for (s = sources; s; s = s->next)
+        ++n;
+    names = xmalloc((n + 1) * sizeof (char *));
+    n = 0;
+    for (s = sources; s; s = s->next)
+        if (s->used && s->kind == SRC_INTERFACE)
+            names[n++] = s->ifname;
+    names[n] = NULL;
+    return names;
+}
+
+/* Returns the polling interval to use in place of interval, which is
+ * shortened while some source in use is cheap to poll. */
+int source_poll_interval(int interval)
+{
+    source_t *s;
+
+    for (s = sources; s; s = s->next)
+        if (s->used && s->kind == SRC_STUN && interval > STUN_POLL_INTERVAL)
+            return STUN_POLL_INTERVAL;
+    return interval;
+}
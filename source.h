@@ -0,0 +1,69 @@
+/* source.h - named address sources that hosts are bound to
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef NDYNDNS_SOURCE_H_
+#define NDYNDNS_SOURCE_H_
+
+#include <net/if.h>
+#include <time.h>
+#include "hostlist.h"
+
+typedef enum {
+    SRC_INTERFACE,              /* address of a local interface */
+    SRC_REMOTE,                 /* address seen by the checkip service */
+    SRC_STATIC,                 /* fixed addresses from the config */
+    SRC_STUN                    /* address seen by the STUN servers */
+} source_kind;
+
+typedef struct source {
+    char *name;
+    source_kind kind;
+    int defined;                /* has a [source] section, or is default */
+    int used;                   /* some host is bound to it */
+    int ipv6;                   /* also find an IPv6 address */
+    char ifname[IFNAMSIZ];      /* SRC_INTERFACE */
+    int bind;                   /* SRC_REMOTE, SRC_STUN query through ifname */
+    char *addr4;                /* SRC_STATIC */
+    char *addr6;
+    time_t last_query;          /* SRC_REMOTE rate limit, wall clock */
+    time_t last_query6;
+    curaddr_t cur;
+    struct source *next;
+} source_t;
+
+source_t *source_default(void);
+source_t *source_get(char *name);
+source_t *source_first(void);
+int source_check(source_t *s);
+void source_validate(void);
+void source_refresh(void);
+int source_have_addr(void);
+char **source_ifnames(void);
+int source_poll_interval(int interval);
+
+#endif
@@ -0,0 +1,439 @@
+/* state.c - journaled per-host update state
+ *
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "defines.h"
+#include "state.h"
+#include "log.h"
+#include "util.h"
+#include "strl.h"
+#include "chroot.h"
+#include "malloc.h"
+
+/*
+ * All host state lives in a single append-only journal, var/ndyndns.state.
+ * Each line is a complete record for one host:
+ *
+ *   <host> <ip|-> <date> <err|->
+ *
+ * where the ip field is "v4", "v4,v6" or "-,v6" once an IPv6 address has
+ * been published, and a later line for the same host supersedes any earlier
+ * one.  Changes made during an update cycle are only held in memory until
+ * state_commit(), which appends one line per changed host and then issues a
+ * single fsync.  An unterminated final line left by a crash is cut off when
+ * the journal is loaded.
+ * Once the journal holds enough superseded lines, it is rewritten from the
+ * in-memory table and atomically renamed into place.
+ *
+ * Hosts that have no journal record yet are imported from the per-host
+ * var/<host>-dnsip, -dnsdate and -dnserr files used by older versions.
+ * The -dnserr file is still written when a host is locked, and removing it
+ * remains the way to clear the lock.
+ */
+#define STATE_FILE "ndyndns.state"
+#define STATE_TMPFILE "ndyndns.state.tmp"
+
+static state_rec_t *records;
+static htab_t index_recs;
+static int loaded;
+static int dirfd_var = -1;       /* var/ within the chroot */
+static int logfd = -1;
+static unsigned int log_lines;  /* lines in the journal */
+
+static state_rec_t *find_rec(char *host)
+{
+    return (state_rec_t *)htab_find(&index_recs, host);
+}
+
+static state_rec_t *new_rec(char *host)
+{
+    state_rec_t *r = xmalloc(sizeof (state_rec_t));
+
+    memset(r, 0, sizeof *r);
+    r->host = strdup(host);
+    r->node.key = r->host;
+    htab_insert(&index_recs, &r->node);
+    r->next = records;
+    records = r;
+    return r;
+}
+
+/* "-" stands for an empty field */
+static char *field(char *s)
+{
+    if (!s || !strcmp(s, "-"))
+        return NULL;
+    return s;
+}
+
+static char *dupfield(char *s)
+{
+    s = field(s);
+    return s ? strdup(s) : NULL;
+}
+
+static void replay_line(char *line)
+{
+    char *host, *ip, *ip6, *date, *err, *save = NULL;
+    state_rec_t *r;
+
+    host = strtok_r(line, " \n", &save);
+    ip = strtok_r(NULL, " \n", &save);
+    date = strtok_r(NULL, " \n", &save);
+    err = strtok_r(NULL, "\n", &save);
+    if (!host || !ip || !date || !err)
+        return; /* torn write at the tail */
+
+    ++log_lines;
+    r = find_rec(host);
+    if (!r)
+        r = new_rec(host);
+    ip6 = strchr(ip, ',');
+    if (ip6)
+        *ip6++ = '\0';
+    free(r->err);
+    addr_set(&r->ip, field(ip));
+    addr_set(&r->ip6, field(ip6));
+    r->date = (time_t)atol(date);
+    if (r->date < 0)
+        r->date = 0;
+    r->err = dupfield(err);
+}
+
+static void state_load(void)
+{
+    char path[MAX_PATH_LENGTH], buf[MAX_BUF];
+    off_t end = 0, size = 0;
+    FILE *f;
+    int fd;
+
+    if (loaded)
+        return;
+    loaded = 1;
+
+    if (strnkcpy(path, get_chroot(), sizeof path) ||
+        strnkcat(path, "/var", sizeof path))
+        suicide("%s: chroot path is too long", __func__);
+    /* After imprisonment, the chroot path is no longer known. */
+    if (!strcmp(path, "/var"))
+        strnkcpy(path, "var", sizeof path);
+
+    dirfd_var = open(path, O_RDONLY | O_DIRECTORY);
+    if (dirfd_var == -1)
+        suicide("%s: failed to open %s: %s", __func__, path, strerror(errno));
+
+    fd = openat(dirfd_var, STATE_FILE, O_RDONLY);
+    if (fd == -1) {
+        if (errno != ENOENT)
+            suicide("%s: failed to open %s/%s: %s", __func__, path,
+                    STATE_FILE, strerror(errno));
+        log_line("No existing state journal.  Importing per-host state files.");
+    } else {
+        f = fdopen(fd, "r");
+        if (!f)
+            suicide("%s: fdopen failed", __func__);
+        while (fgets(buf, sizeof buf, f)) {
+            if (buf[strlen(buf) - 1] == '\n')
+                end = ftello(f);
+            replay_line(buf);
+        }
+        size = ftello(f);
+        fclose(f);
+    }
+
+    logfd = openat(dirfd_var, STATE_FILE,
+                   O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR);
+    if (logfd == -1)
+        suicide("%s: failed to open %s/%s for write: %s", __func__, path,
+                STATE_FILE, strerror(errno));
+
+    /* Cut a torn final line so that the next append starts a fresh line. */
+    if (size > end) {
+        log_line("Discarding %lld torn bytes at the end of the state journal.",
+                 (long long)(size - end));
+        if (ftruncate(logfd, end) == -1)
+            suicide("%s: failed to truncate %s/%s: %s", __func__, path,
+                    STATE_FILE, strerror(errno));
+    }
+}
+
+/* Reads the first line of var/<host><suffix> into buf.  Returns 1 if the
+ * file exists, 0 if not. */
+static int legacy_read(char *host, char *suffix, char *buf, size_t buflen)
+{
+    char file[MAX_PATH_LENGTH];
+    FILE *f;
+    int fd;
+
+    buf[0] = '\0';
+    if (strnkcpy(file, host, sizeof file) ||
+        strnkcat(file, suffix, sizeof file))
+        return 0;
+
+    fd = openat(dirfd_var, file, O_RDONLY);
+    if (fd == -1)
+        return 0;
+    f = fdopen(fd, "r");
+    if (!f) {
+        close(fd);
+        return 0;
+    }
+    if (!fgets(buf, buflen, f))
+        buf[0] = '\0';
+    fclose(f);
+    buf[strcspn(buf, "\r\n")] = '\0';
+    return 1;
+}
+
+static state_rec_t *legacy_import(char *host)
+{
+    char ipbuf[MAX_BUF], datebuf[MAX_BUF], errbuf[MAX_BUF];
+    int hasip, hasdate, haserr;
+    struct in_addr inr;
+    state_rec_t *r;
+
+    hasip = legacy_read(host, "-dnsip", ipbuf, sizeof ipbuf);
+    hasdate = legacy_read(host, "-dnsdate", datebuf, sizeof datebuf);
+    haserr = legacy_read(host, "-dnserr", errbuf, sizeof errbuf);
+    if (!hasip && !hasdate && !haserr)
+        return NULL;
+
+    r = new_rec(host);
+    if (hasip) {
+        if (inet_aton(ipbuf, &inr))
+            r->ip = addr_dup(ipbuf);
+        else
+            log_line("%s-dnsip is corrupt.  Ignoring it.", host);
+    }
+    if (hasdate && atol(datebuf) > 0)
+        r->date = (time_t)atol(datebuf);
+    if (haserr)
+        r->err = strdup(*errbuf ? errbuf : "unknown");
+    r->dirty = 1;
+    log_line("imported legacy state for [%s]", host);
+    return r;
+}
+
+/* Returns the state record for host, or NULL if nothing is known. */
+state_rec_t *state_lookup(char *host)
+{
+    state_rec_t *r;
+    char buf[MAX_BUF];
+
+    if (!host)
+        suicide("%s: host is NULL", __func__);
+    state_load();
+
+    r = find_rec(host);
+    if (!r)
+        return legacy_import(host);
+
+    /* A lock is cleared by removing the host's -dnserr file. */
+    if (r->err && !legacy_read(host, "-dnserr", buf, sizeof buf)) {
+        log_line("%s-dnserr was removed.  Clearing error lock.", host);
+        free(r->err);
+        r->err = NULL;
+        r->dirty = 1;
+    }
+    return r;
+}
+
+static state_rec_t *get_rec(char *host)
+{
+    state_rec_t *r;
+
+    if (!host)
+        suicide("%s: host is NULL", __func__);
+    state_load();
+    r = find_rec(host);
+    if (!r)
+        r = new_rec(host);
+    r->dirty = 1;
+    return r;
+}
+
+void state_set_ip(char *host, char *ip)
+{
+    state_rec_t *r = get_rec(host);
+
+    addr_set(&r->ip, ip);
+}
+
+void state_set_ip6(char *host, char *ip6)
+{
+    state_rec_t *r = get_rec(host);
+
+    addr_set(&r->ip6, ip6);
+}
+
+void state_set_date(char *host, time_t date)
+{
+    get_rec(host)->date = date;
+}
+
+void state_set_err(char *host, char *err)
+{
+    state_rec_t *r = get_rec(host);
+
+    free(r->err);
+    r->err = err ? strdup(err) : NULL;
+}
+
+/* Removes the error lock of host, and the -dnserr file that marks it.
+ * Returns -1 if host was not locked. */
+int state_clear_err(char *host)
+{
+    state_rec_t *r = state_lookup(host);
+    char file[MAX_PATH_LENGTH];
+
+    if (!r || !r->err)
+        return -1;
+    if (!strnkcpy(file, host, sizeof file) &&
+        !strnkcat(file, "-dnserr", sizeof file) &&
+        unlinkat(dirfd_var, file, 0) && errno != ENOENT)
+        log_line("%s: failed to remove [%s]: %s", __func__, file,
+                 strerror(errno));
+    free(r->err);
+    r->err = NULL;
+    r->dirty = 1;
+    return 0;
+}
+
+static int format_rec(state_rec_t *r, char *buf, size_t len)
+{
+    int n;
+
+    n = snprintf(buf, len, "%s %s%s%s %lu %s\n", r->host,
+                 r->ip ? r->ip : "-", r->ip6 ? "," : "", r->ip6 ? r->ip6 : "",
+                 (unsigned long)r->date, r->err ? r->err : "-");
+    if (n < 0 || (size_t)n >= len) {
+        log_line("%s: state for [%s] is too long to record", __func__,
+                 r->host);
+        return 0;
+    }
+    return n;
+}
+
+static void write_all(int fd, char *buf, size_t len)
+{
+    ssize_t r;
+
+    while (len) {
+        r = write(fd, buf, len);
+        if (r == -1) {
+            if (errno == EINTR)
+                continue;
+            suicide("%s: write() failed on state journal: %s", __func__,
+                    strerror(errno));
+        }
+        buf += r;
+        len -= r;
+    }
+}
+
+/* Rewrites the journal with one line per host. */
+static void state_compact(void)
+{
+    char buf[MAX_BUF];
+    state_rec_t *r;
+    unsigned int lines = 0;
+    int fd, n;
+
+    fd = openat(dirfd_var, STATE_TMPFILE, O_WRONLY | O_CREAT | O_TRUNC,
+                S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        log_line("%s: failed to open %s: %s", __func__, STATE_TMPFILE,
+                 strerror(errno));
+        return;
+    }
+    for (r = records; r; r = r->next) {
+        n = format_rec(r, buf, sizeof buf);
+        if (n) {
+            write_all(fd, buf, n);
+            ++lines;
+        }
+    }
+    fsync(fd);
+    if (renameat(dirfd_var, STATE_TMPFILE, dirfd_var, STATE_FILE) == -1) {
+        log_line("%s: failed to replace %s: %s", __func__, STATE_FILE,
+                 strerror(errno));
+        close(fd);
+        unlinkat(dirfd_var, STATE_TMPFILE, 0);
+        return;
+    }
+    fsync(dirfd_var);
+    close(logfd);
+    logfd = openat(dirfd_var, STATE_FILE, O_WRONLY | O_APPEND);
+    if (logfd == -1)
+        suicide("%s: failed to reopen %s: %s", __func__, STATE_FILE,
+                strerror(errno));
+    close(fd);
+    log_lines = lines;
+}
+
+/* Appends every changed record to the journal and makes it durable with
+ * a single fsync. */
+void state_commit(void)
+{
+    char buf[MAX_BUF];
+    state_rec_t *r;
+    int n, wrote = 0;
+
+    if (!loaded)
+        return;
+
+    for (r = records; r; r = r->next) {
+        if (!r->dirty)
+            continue;
+        r->dirty = 0;
+        n = format_rec(r, buf, sizeof buf);
+        if (!n)
+            continue;
+        write_all(logfd, buf, n);
+        ++log_lines;
+        wrote = 1;
+    }
+    if (!wrote)
+        return;
+    if (fsync(logfd) == -1)
+        log_line("%s: fsync failed on state journal: %s", __func__,
+                 strerror(errno));
+
+    if (log_lines > 2 * index_recs.count + STATE_COMPACT_SLACK)
+        state_compact();
+}
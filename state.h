@@ -0,0 +1,55 @@
+/* state.h - journaled per-host update state
+ *
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef NDYNDNS_STATE_H_
+#define NDYNDNS_STATE_H_
+
+#include <time.h>
+#include "htab.h"
+
+typedef struct state_rec {
+    hnode_t node;               /* keyed by host */
+    char *host;
+    char *ip;                   /* last published address or NULL */
+    char *ip6;                  /* ... and IPv6 address, or NULL */
+    time_t date;                /* time of last successful update */
+    char *err;                  /* non-NULL if updates are locked */
+    int dirty;
+    struct state_rec *next;
+} state_rec_t;
+
+state_rec_t *state_lookup(char *host);
+void state_set_ip(char *host, char *ip);
+void state_set_ip6(char *host, char *ip6);
+void state_set_date(char *host, time_t date);
+void state_set_err(char *host, char *err);
+int state_clear_err(char *host);
+void state_commit(void);
+
+#endif
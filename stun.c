@@ -0,0 +1,315 @@
+/* stun.c - external address discovery with STUN Binding requests
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "defines.h"
+#include "stun.h"
+#include "util.h"
+#include "arena.h"
+#include "log.h"
+#include "strl.h"
+#include "malloc.h"
+#include "linux.h"
+
+/*
+ * An RFC 5389 Binding request is a bare 20 byte header sent over UDP; the
+ * server answers with the source address it saw in an XOR-MAPPED-ADDRESS
+ * attribute.  A query sends the request to every address of every
+ * configured server at once and takes the first answer that carries our
+ * transaction id, retransmitting with a doubling timeout until STUN_TRIES
+ * rounds go unanswered.  Server names are resolved again every
+ * CHECKIP_INTERVAL seconds, or after a query fails.
+ */
+
+#define STUN_HDR_LEN 20
+#define STUN_MAX_MSG 548
+#define STUN_MAGIC 0x2112A442UL
+#define STUN_BINDING_REQUEST 0x0001
+#define STUN_BINDING_SUCCESS 0x0101
+#define STUN_ATTR_MAPPED 0x0001
+#define STUN_ATTR_XOR_MAPPED 0x0020
+#define STUN_MAX_ADDRS 4
+
+typedef struct stun_server {
+    char *host;
+    char *port;
+    struct sockaddr_storage addr[STUN_MAX_ADDRS];
+    socklen_t addrlen[STUN_MAX_ADDRS];
+    int naddr;
+    time_t resolved;            /* monotonic; 0 to resolve again */
+    struct stun_server *next;
+} stun_server_t;
+
+static stun_server_t *servers, *servers_tail;
+
+/* Adds a server given as host, host:port or [v6addr]:port. */
+void stun_add_server(char *spec)
+{
+    stun_server_t *s = xmalloc(sizeof (stun_server_t));
+    char *host = strdup(spec), *port = NULL, *p;
+
+    if (host[0] == '[') {
+        p = strchr(host, ']');
+        if (!p)
+            suicide("stunserver [%s] is malformed.  Exiting.", spec);
+        *p++ = '\0';
+        if (*p == ':')
+            port = p + 1;
+        memmove(host, host + 1, strlen(host));
+    } else if ((p = strchr(host, ':')) && !strchr(p + 1, ':')) {
+        *p = '\0';
+        port = p + 1;
+    }
+
+    memset(s, 0, sizeof *s);
+    s->host = host;
+    s->port = strdup(port && *port ? port : STUN_PORT);
+    if (servers_tail)
+        servers_tail->next = s;
+    else
+        servers = s;
+    servers_tail = s;
+}
+
+int stun_have_servers(void)
+{
+    return servers != NULL;
+}
+
+static void stun_resolve(stun_server_t *s, time_t now)
+{
+    struct addrinfo hints, *ai, *p;
+    int err;
+
+    if (s->resolved && now - s->resolved < CHECKIP_INTERVAL)
+        return;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    err = getaddrinfo(s->host, s->port, &hints, &ai);
+    if (err) {
+        log_line("stun: failed to resolve [%s]: %s", s->host,
+                 gai_strerror(err));
+        return;
+    }
+    s->naddr = 0;
+    for (p = ai; p && s->naddr < STUN_MAX_ADDRS; p = p->ai_next) {
+        if (p->ai_addrlen > sizeof s->addr[0])
+            continue;
+        memcpy(&s->addr[s->naddr], p->ai_addr, p->ai_addrlen);
+        s->addrlen[s->naddr++] = p->ai_addrlen;
+    }
+    freeaddrinfo(ai);
+    s->resolved = now;
+}
+
+static void stun_txid(unsigned char *id, size_t len)
+{
+    size_t i;
+    int fd;
+
+    fd = open("/dev/urandom", O_RDONLY);
+    if (fd != -1) {
+        ssize_t r = read(fd, id, len);
+        close(fd);
+        if (r == (ssize_t)len)
+            return;
+    }
+    for (i = 0; i < len; ++i)
+        id[i] = random() & 0xff;
+}
+
+/* Binds fd to the address of iface so that the request leaves by it. */
+static int stun_bind(int fd, int af, char *iface)
+{
+    struct sockaddr_storage ss;
+    socklen_t len;
+    char *ip;
+    int ok;
+
+    ip = af == AF_INET6 ? get_interface_ip6(iface) : get_interface_ip(iface);
+    if (!ip)
+        return -1;
+    memset(&ss, 0, sizeof ss);
+    if (af == AF_INET6) {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+        sin6->sin6_family = AF_INET6;
+        ok = inet_pton(AF_INET6, ip, &sin6->sin6_addr) == 1;
+        len = sizeof *sin6;
+    } else {
+        struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+        sin->sin_family = AF_INET;
+        ok = inet_pton(AF_INET, ip, &sin->sin_addr) == 1;
+        len = sizeof *sin;
+    }
+    if (!ok || bind(fd, (struct sockaddr *)&ss, len) == -1) {
+        log_line("stun: failed to bind to [%s]", iface);
+        return -1;
+    }
+    return 0;
+}
+
+/* Returns 1 and writes the mapped address of family af to out if msg is a
+ * Binding success response to the request whose header is req. */
+static int stun_parse(const unsigned char *msg, size_t len,
+                      const unsigned char *req, int af, char *out,
+                      size_t outlen)
+{
+    const unsigned char *a, *v, *found = NULL;
+    unsigned char addr[16];
+    size_t mlen, alen, i;
+    unsigned int type;
+    int found_xor = 0;
+
+    if (len < STUN_HDR_LEN)
+        return 0;
+    if (((msg[0] << 8) | msg[1]) != STUN_BINDING_SUCCESS)
+        return 0;
+    mlen = (msg[2] << 8) | msg[3];
+    if (STUN_HDR_LEN + mlen > len || memcmp(msg + 4, req + 4, 16))
+        return 0;
+
+    for (a = msg + STUN_HDR_LEN; a + 4 <= msg + STUN_HDR_LEN + mlen;
+         a += 4 + ((alen + 3) & ~(size_t)3)) {
+        type = (a[0] << 8) | a[1];
+        alen = (a[2] << 8) | a[3];
+        if (a + 4 + alen > msg + STUN_HDR_LEN + mlen)
+            return 0;
+        if (type == STUN_ATTR_XOR_MAPPED) {
+            found = a;
+            found_xor = 1;
+            break;
+        }
+        if (type == STUN_ATTR_MAPPED && !found)
+            found = a;
+    }
+    if (!found)
+        return 0;
+
+    alen = (found[2] << 8) | found[3];
+    v = found + 4;
+    if (alen < 4)
+        return 0;
+    if (af == AF_INET && v[1] == 0x01 && alen >= 8) {
+        memcpy(addr, v + 4, 4);
+        if (found_xor)
+            for (i = 0; i < 4; ++i)
+                addr[i] ^= msg[4 + i];
+    } else if (af == AF_INET6 && v[1] == 0x02 && alen >= 20) {
+        /* xored with the magic cookie and then the transaction id */
+        memcpy(addr, v + 4, 16);
+        if (found_xor)
+            for (i = 0; i < 16; ++i)
+                addr[i] ^= msg[4 + i];
+    } else {
+        return 0;
+    }
+    return inet_ntop(af, addr, out, outlen) != NULL;
+}
+
+/* allocates from the cycle arena for return; returns NULL if no server
+ * tells us our address of family af.  The request is sent from iface
+ * unless it is NULL. */
+char *stun_query(int af, char *iface)
+{
+    unsigned char req[STUN_HDR_LEN], buf[STUN_MAX_MSG];
+    char ip[INET6_ADDRSTRLEN];
+    struct pollfd pfd;
+    stun_server_t *s;
+    time_t now = clock_mono();
+    int fd, i, try, sent, timeout = STUN_RTO;
+    char *ret = NULL;
+
+    fd = socket(af, SOCK_DGRAM, 0);
+    if (fd == -1) {
+        log_line("stun: failed to open socket: %s", strerror(errno));
+        return NULL;
+    }
+    if (iface && stun_bind(fd, af, iface) == -1)
+        goto out;
+
+    req[0] = STUN_BINDING_REQUEST >> 8;
+    req[1] = STUN_BINDING_REQUEST & 0xff;
+    req[2] = req[3] = 0;
+    req[4] = (STUN_MAGIC >> 24) & 0xff;
+    req[5] = (STUN_MAGIC >> 16) & 0xff;
+    req[6] = (STUN_MAGIC >> 8) & 0xff;
+    req[7] = STUN_MAGIC & 0xff;
+    stun_txid(req + 8, 12);
+
+    for (try = 0; try < STUN_TRIES && !ret; ++try, timeout *= 2) {
+        sent = 0;
+        for (s = servers; s; s = s->next) {
+            stun_resolve(s, now);
+            for (i = 0; i < s->naddr; ++i) {
+                if (s->addr[i].ss_family != af)
+                    continue;
+                if (sendto(fd, req, sizeof req, 0,
+                           (struct sockaddr *)&s->addr[i],
+                           s->addrlen[i]) == sizeof req)
+                    ++sent;
+            }
+        }
+        if (!sent) {
+            log_line("stun: no server could be reached over IPv%d.",
+                     af == AF_INET6 ? 6 : 4);
+            break;
+        }
+
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        while (poll(&pfd, 1, timeout) > 0) {
+            ssize_t r = recv(fd, buf, sizeof buf, 0);
+            if (r == -1)
+                break;
+            if (stun_parse(buf, r, req, af, ip, sizeof ip)) {
+                ret = arena_strdup(ip);
+                break;
+            }
+        }
+    }
+    if (!ret) {
+        log_line("stun: no answer from any server.");
+        for (s = servers; s; s = s->next)
+            s->resolved = 0;
+    }
+out:
+    close(fd);
+    return ret;
+}
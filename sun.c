@@ -41,13 +41,13 @@
 #include "log.h"
 #include "strl.h"
 #include "util.h"
+#include "arena.h"
 
-/* allocates from heap for return */
+/* allocates from the cycle arena for return */
 char *get_interface_ip(char *ifname)
 {
     struct lifreq lif;
     char *ret = NULL, *ip;
-    size_t len;
     int r, s;
 
     if (ifname == NULL)
@@ -67,12 +67,31 @@ char *get_interface_ip(char *ifname)
     }
 
     ip = inet_ntoa(((struct sockaddr_in *)lif.lifr_addr)->sin_addr);
-    len = strlen(ip) + 1;
-    ret = xmalloc(len);
-    strnkcpy(ret, ip, len);
+    ret = arena_strdup(ip);
 out2:
     close(s);
 out:
     return ret;
 }
 
+/* Global IPv6 addresses live on logical interfaces that SIOCGLIFADDR on
+ * the physical one does not report, so they are not detected here. */
+char *get_interface_ip6(char *ifname)
+{
+    log_line("%s: IPv6 address detection is not supported on this platform.",
+             ifname ? ifname : "");
+    return NULL;
+}
+
+/* No change notification mechanism; callers fall back to polling. */
+int ifchange_open(void)
+{
+    return -1;
+}
+
+char *ifchange_read(int fd, char **ifnames)
+{
+    (void)fd;
+    (void)ifnames;
+    return NULL;
+}
@@ -29,5 +29,8 @@
 #ifndef NJK_IFCHD_SUN_H_
 #define NJK_IFCHD_SUN_H_ 1
 char *get_interface_ip(char *ifname);
+char *get_interface_ip6(char *ifname);
+int ifchange_open(void);
+char *ifchange_read(int fd, char **ifnames);
 #endif
 
@@ -0,0 +1,446 @@
+/* transport.c - persistent cURL handles for update endpoints
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <curl/curl.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
+#include "config.h"
+#include "defines.h"
+#include "transport.h"
+#include "metrics.h"
+#include "log.h"
+#include "strl.h"
+#include "malloc.h"
+
+/*
+ * Each provider endpoint keeps a small pool of easy handles that live for
+ * the life of the daemon.  An easy handle keeps its connection open between
+ * requests, and all handles share a single DNS, TLS session and connection
+ * cache, so back-to-back updates to the same server skip the lookup and
+ * handshakes.
+ *
+ * Transfers are either performed synchronously (transport_perform()) or
+ * queued with transport_submit() and driven concurrently by transport_run(),
+ * which keeps at most MAX_XFERS_PER_EP requests in flight to any one
+ * endpoint and MAX_XFERS overall.
+ *
+ * Requests over https offer HTTP/2.  Once an endpoint has answered with it,
+ * its requests are sent as streams over a shared connection, up to
+ * MAX_STREAMS_PER_EP at a time, and count as a single connection against
+ * MAX_XFERS.  Servers that do not speak HTTP/2 get HTTP/1.1 with keep-alive
+ * as before.
+ */
+typedef struct pool_handle {
+    CURL *h;
+    struct pool_handle *next;
+} pool_handle_t;
+
+typedef struct {
+    pool_handle_t *idle;
+    xfer_t *pending, *pending_tail;
+    int active;
+    int mux;                    /* last answer came over HTTP/2 */
+} endpoint_t;
+
+static CURLSH *share;
+static CURLM *multi;
+static endpoint_t endpoints[EP_MAX];
+static pool_handle_t *spare;    /* unused pool nodes, kept for reuse */
+static int active;
+static char useragent[64];
+
+transport_stats_t transport_stats;
+
+#ifdef __linux__
+static int epfd = -1;
+static long multi_timeout = -1;
+#endif
+
+static void transport_init(void)
+{
+    if (share)
+        return;
+
+    strnkcpy(useragent, "ndyndns/", sizeof useragent);
+    strnkcat(useragent, PACKAGE_VERSION, sizeof useragent);
+
+    share = curl_share_init();
+    if (!share)
+        suicide("%s: curl_share_init failed", __func__);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+}
+
+static CURL *handle_get(endpoint_id ep)
+{
+    endpoint_t *e = &endpoints[ep];
+    pool_handle_t *p;
+    CURL *h;
+
+    if (e->idle) {
+        p = e->idle;
+        e->idle = p->next;
+        h = p->h;
+        p->next = spare;
+        spare = p;
+        curl_easy_reset(h);
+        return h;
+    }
+    h = curl_easy_init();
+    if (!h)
+        suicide("%s: curl_easy_init failed", __func__);
+    return h;
+}
+
+static void handle_put(endpoint_id ep, CURL *h)
+{
+    pool_handle_t *p = spare;
+
+    if (p)
+        spare = p->next;
+    else
+        p = xmalloc(sizeof (pool_handle_t));
+    p->h = h;
+    p->next = endpoints[ep].idle;
+    endpoints[ep].idle = p;
+}
+
+static void xfer_setup(xfer_t *x)
+{
+    CURL *h;
+
+    if (x->ep < 0 || x->ep >= EP_MAX)
+        suicide("%s: invalid endpoint %d", __func__, x->ep);
+    transport_init();
+
+    x->err[0] = '\0';
+    x->h = h = handle_get(x->ep);
+    curl_easy_setopt(h, CURLOPT_SHARE, share);
+    curl_easy_setopt(h, CURLOPT_PRIVATE, x);
+    curl_easy_setopt(h, CURLOPT_URL, x->url);
+    curl_easy_setopt(h, CURLOPT_USERAGENT, useragent);
+    curl_easy_setopt(h, CURLOPT_ERRORBUFFER, x->err);
+    curl_easy_setopt(h, CURLOPT_WRITEFUNCTION, resp_write);
+    curl_easy_setopt(h, CURLOPT_WRITEDATA, x->resp);
+    curl_easy_setopt(h, CURLOPT_PROTOCOLS, CURLPROTO_HTTP | CURLPROTO_HTTPS);
+    curl_easy_setopt(h, CURLOPT_REDIR_PROTOCOLS, CURLPROTO_HTTP | CURLPROTO_HTTPS);
+    curl_easy_setopt(h, CURLOPT_TCP_KEEPALIVE, 1L);
+#if LIBCURL_VERSION_NUM >= 0x072f00
+    /* ALPN falls back to HTTP/1.1; plain http always uses it */
+    curl_easy_setopt(h, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    /* wait for a connection that is being set up to say whether it can
+     * multiplex rather than opening another one alongside it */
+    curl_easy_setopt(h, CURLOPT_PIPEWAIT, 1L);
+#endif
+    curl_easy_setopt(h, CURLOPT_CONNECTTIMEOUT, (long)XFER_CONNECT_TIMEOUT);
+    curl_easy_setopt(h, CURLOPT_TIMEOUT, (long)XFER_TIMEOUT);
+    /* the IPv6 address can only be learned by asking over IPv6 */
+    curl_easy_setopt(h, CURLOPT_IPRESOLVE, x->ep == EP_CHECKIP6 ?
+                     CURL_IPRESOLVE_V6 : CURL_IPRESOLVE_WHATEVER);
+    curl_easy_setopt(h, CURLOPT_INTERFACE, x->iface);
+    if (x->unpwd) {
+        curl_easy_setopt(h, CURLOPT_USERPWD, x->unpwd);
+        curl_easy_setopt(h, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
+    }
+    curl_easy_setopt(h, CURLOPT_SSL_VERIFYPEER, (long)0);
+}
+
+static void xfer_finish(xfer_t *x, CURLcode result)
+{
+    long conns = 0;
+
+    curl_easy_getinfo(x->h, CURLINFO_NUM_CONNECTS, &conns);
+    transport_stats.connects += conns;
+    ++transport_stats.requests;
+    if (resp_finish(x->resp) && result == CURLE_WRITE_ERROR)
+        result = CURLE_OK;
+    metrics_record(x->ep, result, x->h);
+    curl_easy_getinfo(x->h, CURLINFO_RESPONSE_CODE, &x->resp->status);
+#if LIBCURL_VERSION_NUM >= 0x073200
+    if (result == CURLE_OK) {
+        long ver = 0;
+        curl_easy_getinfo(x->h, CURLINFO_HTTP_VERSION, &ver);
+        endpoints[x->ep].mux = ver == CURL_HTTP_VERSION_2_0;
+        if (endpoints[x->ep].mux)
+            ++transport_stats.streams;
+    }
+#endif
+#if LIBCURL_VERSION_NUM >= 0x074200
+    {
+        curl_off_t ra = 0;
+        curl_easy_getinfo(x->h, CURLINFO_RETRY_AFTER, &ra);
+        x->resp->retry_after = (long)ra;
+    }
+#endif
+    x->result = result;
+    handle_put(x->ep, x->h);
+    x->h = NULL;
+}
+
+CURLcode transport_perform(xfer_t *x)
+{
+    xfer_setup(x);
+    xfer_finish(x, curl_easy_perform(x->h));
+    return x->result;
+}
+
+void transport_submit(xfer_t *x)
+{
+    endpoint_t *e;
+
+    if (x->ep < 0 || x->ep >= EP_MAX)
+        suicide("%s: invalid endpoint %d", __func__, x->ep);
+    e = &endpoints[x->ep];
+    x->next = NULL;
+    if (e->pending_tail)
+        e->pending_tail->next = x;
+    else
+        e->pending = x;
+    e->pending_tail = x;
+}
+
+#ifdef __linux__
+static int sock_cb(CURL *h, curl_socket_t s, int what, void *userp,
+                   void *sockp)
+{
+    struct epoll_event ev;
+    (void)h;
+    (void)userp;
+
+    if (what == CURL_POLL_REMOVE) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, s, NULL);
+        curl_multi_assign(multi, s, NULL);
+        return 0;
+    }
+
+    memset(&ev, 0, sizeof ev);
+    ev.data.fd = s;
+    if (what & CURL_POLL_IN)
+        ev.events |= EPOLLIN;
+    if (what & CURL_POLL_OUT)
+        ev.events |= EPOLLOUT;
+    if (sockp) {
+        if (epoll_ctl(epfd, EPOLL_CTL_MOD, s, &ev) == -1)
+            log_line("%s: epoll_ctl(MOD) failed: %s", __func__,
+                     strerror(errno));
+    } else {
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, s, &ev) == -1)
+            log_line("%s: epoll_ctl(ADD) failed: %s", __func__,
+                     strerror(errno));
+        curl_multi_assign(multi, s, &epfd);
+    }
+    return 0;
+}
+
+static int timer_cb(CURLM *m, long timeout_ms, void *userp)
+{
+    (void)m;
+    (void)userp;
+    multi_timeout = timeout_ms;
+    return 0;
+}
+#endif
+
+static void multi_init(void)
+{
+    if (multi)
+        return;
+    multi = curl_multi_init();
+    if (!multi)
+        suicide("%s: curl_multi_init failed", __func__);
+    curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)MAX_XFERS);
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+                      (long)MAX_XFERS_PER_EP);
+#if LIBCURL_VERSION_NUM >= 0x072b00
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x074300
+    curl_multi_setopt(multi, CURLMOPT_MAX_CONCURRENT_STREAMS,
+                      (long)MAX_STREAMS_PER_EP);
+#endif
+#ifdef __linux__
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd == -1)
+        suicide("%s: epoll_create1 failed: %s", __func__, strerror(errno));
+    curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, sock_cb);
+    curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, timer_cb);
+#endif
+}
+
+/* Returns the number of connections that the transfers in flight hold;
+ * those to an endpoint that multiplexes share one. */
+static int conns_active(void)
+{
+    int ep, n = 0;
+
+    for (ep = 0; ep < EP_MAX; ++ep) {
+        endpoint_t *e = &endpoints[ep];
+        n += e->mux ? e->active > 0 : e->active;
+    }
+    return n;
+}
+
+static int endpoint_has_room(endpoint_t *e)
+{
+    if (e->mux)
+        return e->active < MAX_STREAMS_PER_EP &&
+               (e->active || conns_active() < MAX_XFERS);
+    return e->active < MAX_XFERS_PER_EP && conns_active() < MAX_XFERS;
+}
+
+/* Moves pending transfers into the multi handle while under the caps.
+ * Endpoints are visited in turn so that one long queue cannot starve
+ * the others. */
+static void start_pending(void)
+{
+    int ep, started;
+    xfer_t *x;
+
+    do {
+        started = 0;
+        for (ep = 0; ep < EP_MAX; ++ep) {
+            endpoint_t *e = &endpoints[ep];
+            if (!e->pending || !endpoint_has_room(e))
+                continue;
+            x = e->pending;
+            e->pending = x->next;
+            if (!e->pending)
+                e->pending_tail = NULL;
+            if (x->start)
+                x->start(x);
+            xfer_setup(x);
+            curl_multi_add_handle(multi, x->h);
+            ++e->active;
+            ++active;
+            started = 1;
+        }
+    } while (started);
+}
+
+static void reap_done(void)
+{
+    CURLMsg *msg;
+    xfer_t *x;
+    int left;
+
+    while ((msg = curl_multi_info_read(multi, &left))) {
+        if (msg->msg != CURLMSG_DONE)
+            continue;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&x);
+        curl_multi_remove_handle(multi, x->h);
+        xfer_finish(x, msg->data.result);
+        --endpoints[x->ep].active;
+        --active;
+        if (x->done)
+            x->done(x);
+    }
+}
+
+/* Abandons a transfer that was submitted but has not completed; its done
+ * callback is not called.  May be called from another transfer's done
+ * callback. */
+void transport_cancel(xfer_t *x)
+{
+    endpoint_t *e = &endpoints[x->ep];
+    xfer_t *p, *prev = NULL;
+
+    if (x->h) {
+        /* The partly read connection is closed rather than reused. */
+        curl_multi_remove_handle(multi, x->h);
+        handle_put(x->ep, x->h);
+        x->h = NULL;
+        --e->active;
+        --active;
+        return;
+    }
+    for (p = e->pending; p; prev = p, p = p->next) {
+        if (p != x)
+            continue;
+        if (prev)
+            prev->next = x->next;
+        else
+            e->pending = x->next;
+        if (e->pending_tail == x)
+            e->pending_tail = prev;
+        return;
+    }
+}
+
+/* Runs every submitted transfer to completion, invoking each one's done
+ * callback as it finishes.  Callbacks may submit further transfers. */
+void transport_run(void)
+{
+    int running;
+
+    transport_init();
+    multi_init();
+    start_pending();
+
+    while (active) {
+#ifdef __linux__
+        struct epoll_event evs[MAX_XFERS];
+        int i, n;
+
+        n = epoll_wait(epfd, evs, MAX_XFERS, multi_timeout);
+        if (n == -1) {
+            if (errno != EINTR)
+                suicide("%s: epoll_wait failed: %s", __func__,
+                        strerror(errno));
+            continue;
+        }
+        if (n == 0)
+            curl_multi_socket_action(multi, CURL_SOCKET_TIMEOUT, 0,
+                                     &running);
+        for (i = 0; i < n; ++i) {
+            int flags = 0;
+            if (evs[i].events & EPOLLIN)
+                flags |= CURL_CSELECT_IN;
+            if (evs[i].events & EPOLLOUT)
+                flags |= CURL_CSELECT_OUT;
+            if (evs[i].events & (EPOLLERR | EPOLLHUP))
+                flags |= CURL_CSELECT_ERR;
+            curl_multi_socket_action(multi, evs[i].data.fd, flags, &running);
+        }
+#else
+        curl_multi_perform(multi, &running);
+        if (running)
+            curl_multi_wait(multi, NULL, 0, 1000, NULL);
+#endif
+        reap_done();
+        start_pending();
+    }
+}
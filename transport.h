@@ -0,0 +1,77 @@
+/* transport.h - persistent cURL handles for update endpoints
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef NDYNDNS_TRANSPORT_H_
+#define NDYNDNS_TRANSPORT_H_
+
+#include <curl/curl.h>
+#include "response.h"
+
+typedef enum {
+    EP_DYNDNS,
+    EP_NAMECHEAP,
+    EP_HE_DNS,
+    EP_HE_TUN,
+    EP_CHECKIP,
+    EP_CHECKIP6,
+    EP_MAX
+} endpoint_id;
+
+typedef struct xfer xfer_t;
+typedef void (*xfer_fn)(xfer_t *x);
+
+struct xfer {
+    endpoint_id ep;
+    char *url;
+    char *unpwd;              /* may be NULL */
+    char *iface;              /* may be NULL; local interface to use */
+    resp_t *resp;
+    xfer_fn start;            /* may be NULL; called just before sending */
+    xfer_fn done;             /* may be NULL; called on completion */
+    void *arg;
+    CURLcode result;
+    char err[CURL_ERROR_SIZE];
+    /* private */
+    CURL *h;                  /* NULL unless in flight */
+    xfer_t *next;
+};
+
+typedef struct {
+    unsigned long requests;     /* completed transfers */
+    unsigned long connects;     /* new connections, each with a handshake */
+    unsigned long streams;      /* transfers answered over HTTP/2 */
+} transport_stats_t;
+
+extern transport_stats_t transport_stats;
+
+CURLcode transport_perform(xfer_t *x);
+void transport_submit(xfer_t *x);
+void transport_cancel(xfer_t *x);
+void transport_run(void);
+
+#endif
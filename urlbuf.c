@@ -0,0 +1,141 @@
+/* urlbuf.c - growable, length-tracked buffer for building request URLs
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "urlbuf.h"
+#include "malloc.h"
+
+/*
+ * Appends run in time proportional to what is appended: the length is
+ * kept, so nothing rescans the buffer, and the buffer doubles as needed,
+ * so there is no fixed ceiling.  The contents are always NUL terminated.
+ */
+
+static void ub_reserve(urlbuf_t *b, size_t n)
+{
+    char *nb;
+    size_t size;
+
+    if (b->len + n < b->size)
+        return;
+    size = b->size ? b->size : 128;
+    while (b->len + n >= size)
+        size *= 2;
+    nb = xmalloc(size);
+    if (b->len)
+        memcpy(nb, b->buf, b->len);
+    nb[b->len] = '\0';
+    free(b->buf);
+    b->buf = nb;
+    b->size = size;
+}
+
+void ub_free(urlbuf_t *b)
+{
+    free(b->buf);
+    memset(b, 0, sizeof *b);
+}
+
+/* Cuts b back to its first len bytes. */
+void ub_trunc(urlbuf_t *b, size_t len)
+{
+    if (len > b->len)
+        return;
+    b->len = len;
+    if (b->buf)
+        b->buf[len] = '\0';
+}
+
+void ub_putn(urlbuf_t *b, const char *s, size_t n)
+{
+    ub_reserve(b, n);
+    memcpy(b->buf + b->len, s, n);
+    b->len += n;
+    b->buf[b->len] = '\0';
+}
+
+void ub_puts(urlbuf_t *b, const char *s)
+{
+    ub_putn(b, s, strlen(s));
+}
+
+void ub_cat(urlbuf_t *b, const urlbuf_t *s)
+{
+    if (s->len)
+        ub_putn(b, s->buf, s->len);
+}
+
+/* Appends the n bytes at s with everything but the RFC 3986 unreserved
+ * characters percent-encoded, so that they are safe in a query value or
+ * in userinfo. */
+void ub_encn(urlbuf_t *b, const char *s, size_t n)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    const unsigned char *p, *end = (const unsigned char *)s + n;
+    char *o;
+
+    ub_reserve(b, 3 * n);
+    o = b->buf + b->len;
+    for (p = (const unsigned char *)s; p < end; ++p) {
+        if ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+            (*p >= '0' && *p <= '9') || *p == '-' || *p == '.' ||
+            *p == '_' || *p == '~') {
+            *o++ = *p;
+        } else {
+            *o++ = '%';
+            *o++ = hex[*p >> 4];
+            *o++ = hex[*p & 15];
+        }
+    }
+    b->len = o - b->buf;
+    b->buf[b->len] = '\0';
+}
+
+void ub_enc(urlbuf_t *b, const char *s)
+{
+    ub_encn(b, s, strlen(s));
+}
+
+/* Appends the provider's base URL: the configured server, without any
+ * trailing slash, or else its own host with the default scheme. */
+void ub_base(urlbuf_t *b, char *server, char *host, int ssl)
+{
+    size_t len;
+
+    if (server) {
+        len = strlen(server);
+        while (len && server[len - 1] == '/')
+            --len;
+        ub_putn(b, server, len);
+        return;
+    }
+    ub_puts(b, ssl ? "https://" : "http://");
+    ub_puts(b, host);
+}
@@ -0,0 +1,49 @@
+/* urlbuf.h - growable, length-tracked buffer for building request URLs
+ *
+ * Copyright (c) 2005-2013 Nicholas J. Kain <njkain at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef NDYNDNS_URLBUF_H_
+#define NDYNDNS_URLBUF_H_
+
+#include <stddef.h>
+
+typedef struct {
+    char *buf;                  /* NULL until something is appended */
+    size_t len;
+    size_t size;
+} urlbuf_t;
+
+void ub_free(urlbuf_t *b);
+void ub_trunc(urlbuf_t *b, size_t len);
+void ub_putn(urlbuf_t *b, const char *s, size_t n);
+void ub_puts(urlbuf_t *b, const char *s);
+void ub_cat(urlbuf_t *b, const urlbuf_t *s);
+void ub_encn(urlbuf_t *b, const char *s, size_t n);
+void ub_enc(urlbuf_t *b, const char *s);
+void ub_base(urlbuf_t *b, char *server, char *host, int ssl);
+
+#endif
@@ -34,6 +34,8 @@
 
 #include "util.h"
 #include "log.h"
+#include "strl.h"
+#include "malloc.h"
 
 void null_crlf(char *data) {
     char *p = data;
@@ -48,23 +50,65 @@ void null_crlf(char *data) {
     }
 }
 
-size_t write_response(char *buf, size_t size, size_t nmemb, void *dat)
+time_t clock_time(void)
 {
-    conn_data_t *data = (conn_data_t *)dat;
-    size_t j;
-
-    for (j=0; data->idx < data->buflen - 1 && j < size*nmemb; ++data->idx, ++j)
-        data->buf[data->idx] = buf[j];
-    data->buf[data->idx + 1] = '\0';
-
-    return j;
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME, &ts))
+        suicide("%s: clock_gettime failed: %s", __func__, strerror(errno));
+    return ts.tv_sec;
 }
 
-time_t clock_time(void)
+/* monotonic seconds; only meaningful for measuring intervals */
+time_t clock_mono(void)
 {
     struct timespec ts;
-    if (clock_gettime(CLOCK_REALTIME, &ts))
+    if (clock_gettime(CLOCK_MONOTONIC, &ts))
         suicide("%s: clock_gettime failed: %s", __func__, strerror(errno));
     return ts.tv_sec;
 }
 
+/* Addresses are kept in presentation form; only IPv6 ones contain ':'. */
+int ip_is_v6(const char *ip)
+{
+    return strchr(ip, ':') != NULL;
+}
+
+/* Returns 1 if a is a global unicast address that is worth publishing:
+ * not loopback, link- or site-local, multicast, IPv4-mapped, or a unique
+ * local address (fc00::/7). */
+int ip6_is_global(const struct in6_addr *a)
+{
+    if (IN6_IS_ADDR_UNSPECIFIED(a) || IN6_IS_ADDR_LOOPBACK(a) ||
+        IN6_IS_ADDR_LINKLOCAL(a) || IN6_IS_ADDR_SITELOCAL(a) ||
+        IN6_IS_ADDR_MULTICAST(a) || IN6_IS_ADDR_V4MAPPED(a) ||
+        IN6_IS_ADDR_V4COMPAT(a))
+        return 0;
+    return (a->s6_addr[0] & 0xfe) != 0xfc;
+}
+
+/* Recorded addresses are all held in INET6_ADDRSTRLEN blocks, so that a
+ * changed address is copied over the old one in place rather than freeing
+ * and allocating a block of a new size. */
+char *addr_dup(const char *ip)
+{
+    char *ret;
+
+    if (!ip)
+        return NULL;
+    ret = xmalloc(INET6_ADDRSTRLEN);
+    strnkcpy(ret, ip, INET6_ADDRSTRLEN);
+    return ret;
+}
+
+/* Replaces the address at *dst, which must be NULL or from addr_dup(). */
+void addr_set(char **dst, const char *ip)
+{
+    if (!ip) {
+        free(*dst);
+        *dst = NULL;
+    } else if (*dst) {
+        strnkcpy(*dst, ip, INET6_ADDRSTRLEN);
+    } else {
+        *dst = addr_dup(ip);
+    }
+}
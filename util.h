@@ -29,15 +29,14 @@
 #ifndef NJK_UTIL_H_
 #define NJK_UTIL_H_ 1
 #include <time.h>
-
-typedef struct {
-    char *buf;
-    size_t buflen;
-    size_t idx;
-} conn_data_t;
+#include <netinet/in.h>
 
 void null_crlf(char *data);
-size_t write_response(char *buf, size_t size, size_t nmemb, void *dat);
 time_t clock_time(void);
+time_t clock_mono(void);
+int ip_is_v6(const char *ip);
+int ip6_is_global(const struct in6_addr *a);
+char *addr_dup(const char *ip);
+void addr_set(char **dst, const char *ip);
 #endif
 